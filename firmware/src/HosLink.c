@@ -0,0 +1,44 @@
+/*
+ * Copyright 2026 Esrille Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// HosMaster.c must not be modified to maintain the Bluetooth® Qualification
+// of the NISSE. It is built as a part of this file, which adds the accessors
+// HosTasks.c needs to the state kept in it. The bytes exchanged with the BLE
+// module are those of HosMaster.c as it is. Its HosMainLoop() and the other
+// functions replaced by HosTasks.c are never called, and left out by the
+// compiler.
+//
+
+#include "HosMaster.c"
+
+#include <HosTasks.h>
+
+uint16_t HosGetBatteryReading(void)
+{
+    return HOS_BATTERY_VOLTAGE_OFFSET + status[HOS_STATE_BATT];
+}
+
+uint8_t HosGetStatusType(void)
+{
+    return status[HOS_STATE_TYPE];
+}
+
+void HosSetVersion(uint16_t version)
+{
+    info.versionMajor = (uint8_t) (version >> 8);
+    info.versionMinor = (uint8_t) version;
+}
@@ -0,0 +1,1019 @@
+/*
+ * Copyright 2026 Esrille Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// The keyboard side of the BLE link: the scan loop, power management,
+// host switching, battery level and LED indication run on top of the HID
+// over SPI transactions of HosMaster.c, which is kept as qualified.
+//
+
+#include <xc.h>
+#include <HosMaster.h>
+#include <HosTasks.h>
+#include <string.h>
+
+#include "system.h"
+#include "app_led_usb_status.h"
+#include "app_device_keyboard.h"
+#include "app_device_mouse.h"
+
+#include <Keyboard.h>
+#ifdef ENABLE_MOUSE
+#include <Mouse.h>
+#endif
+#include <Scheduler.h>
+
+// BSP indication states
+#define ADVERTISING_DIRECTED_LED_ON_INTERVAL   200      // Directed advertising
+#define ADVERTISING_DIRECTED_LED_OFF_INTERVAL  200      // Period 0.4 sec, duty cycle 50%
+#define ADVERTISING_WHITELIST_LED_ON_INTERVAL  300      // Fast/slow whitelist advertising
+#define ADVERTISING_WHITELIST_LED_OFF_INTERVAL 700      // Period 1 sec, duty cycle 30%
+#define ADVERTISING_LED_ON_INTERVAL            200      // Fast advertising
+#define ADVERTISING_LED_OFF_INTERVAL           800      // Period 1 sec, duty cycle 20%
+#define ADVERTISING_SLOW_LED_ON_INTERVAL       100      // Slow advertizing
+#define ADVERTISING_SLOW_LED_OFF_INTERVAL      900      // Period 1 sec, duty cycle 10%
+#define BONDING_INTERVAL                       100      // Bonding
+#define DFU_LED_ON_INTERVAL                    500      // Waiting for DFU
+#define DFU_LED_OFF_INTERVAL                   500      // Period 1 sec, duty cycle 50%
+
+#define TICK_TIME   (_XTAL_FREQ / 4 / 8 / WDT_FREQ)         // [Timer1 count at 1:8 prescale]
+#define TIMER1_MSEC (_XTAL_FREQ / 4 / 8 / 1000)             // [Timer1 count at 1:8 prescale]
+#define TIMER1_USEC(usec)   (TIMER1_MSEC * (usec) / 1000u)  // [Timer1 count at 1:8 prescale]
+#define SCAN_TIME   (TIMER1_MSEC * APP_KEYBOARD_SCAN_MSEC)  // [Timer1 count at 1:8 prescale]
+
+// The timing of the HosReport() windows in HosMaster.c
+#define RETRY_MAX       5
+#define RETRY_WAIT      TIMER1_USEC(128)
+#define WINDOW_DELAY    TIMER1_USEC(1 + 8 + 2)  // Chip select setup and hold
+#define BYTE_TIME       16                      // [Timer1 count] 8 bits at SPI_FOSC_64
+
+#define BATTERY_LEVEL_MEAS_INTERVAL             (WDT_FREQ * HOS_BATTERY_LEVEL_MEAS_INTERVAL / 1000)
+#define BATTERY_LOAD_SAG                        3       // [1/100V] Voltage drop while reports are sent
+#define BATTERY_HYSTERESIS                      3       // [%] Change needed to report a new level
+#define BATTERY_UNKNOWN                         0xffu   // No level reported yet
+
+// While connected, the status piggybacks on every report. It is polled every
+// tick only for STATUS_ACTIVE ticks after the link was used, and otherwise
+// every STATUS_POLL_INTERVAL ticks as a fallback. While advertising, it is
+// polled every tick so that the new connection is seen at once.
+//
+// A pad touch is only seen in the status. While the keyboard is in use, i.e.,
+// until HOS_IDLE_DELAY after the last activity, the status is polled every
+// PAD_POLL_INTERVAL ticks so that the pointer moves as soon as a hand moves
+// from the keys to the pad. After that, the status is polled only every
+// STATUS_POLL_INTERVAL ticks at the slow scan rate, and the pointer takes
+// about a quarter second to start moving, which saves the transactions while
+// nobody is at the keyboard.
+#define STATUS_ACTIVE                           (WDT_FREQ / 2u)
+#ifdef ENABLE_MOUSE
+#define STATUS_POLL_INTERVAL                    (WDT_FREQ / 10u)
+#define PAD_POLL_INTERVAL                       1u
+#else
+#define STATUS_POLL_INTERVAL                    (WDT_FREQ / 2u)
+#endif
+
+#define MOUSE_REPORT_INTERVAL_HOS               (1000u / WDT_FREQ)  // [msec] At most one mouse report per tick
+
+//
+// The link statistics: HosMaster.c is kept as qualified, so the calls into it
+// are timed here with Timer1. Each window of a call clocks the same number of
+// bytes, and a window answered with HOS_DEF_CHARACTER is followed by
+// RETRY_WAIT, so the windows and retries are told from the duration.
+//
+
+static HosStats stats;
+static uint16_t link_calls;
+static uint32_t link_busy;      // [Timer1 count] Call duration since the last HosGetStats() call
+static uint32_t link_time;      // [msec] Total call duration
+static uint16_t link_frac;      // [Timer1 count] Less than a msec, yet to be added to link_time
+static uint16_t link_start;
+static int8_t   touched;        // TSAP status received since the last CheckTouch() call
+
+// Timer1 runs freely at Fosc/4 with 1:8 prescale in HosRunTasks(). As it
+// stops during Sleep, it measures the time spent awake.
+static uint16_t ReadTimer1(void)
+{
+    uint16_t count = TMR1L;
+    return count | ((uint16_t) TMR1H << 8);
+}
+
+static void CountUp(uint16_t* counter, uint16_t n)
+{
+    if (*counter < 0xffff - n)
+        *counter += n;
+    else
+        *counter = 0xffff;
+}
+
+static void StartLink(void)
+{
+    link_start = ReadTimer1();
+}
+
+static int8_t StopLink(int8_t good, uint8_t cmd, uint8_t len)
+{
+    uint16_t count = ReadTimer1() - link_start;
+    uint8_t bytes = (len + 3u < HOS_STATE_LAST + 1u) ? HOS_STATE_LAST + 1u : len + 3u;
+    uint16_t window = WINDOW_DELAY + BYTE_TIME * bytes;
+    uint8_t windows;
+    uint8_t retries;
+    uint32_t frac;
+
+    // Round to the nearest number of windows, and then of retry waits.
+    windows = (uint8_t) ((count + RETRY_WAIT + (window + RETRY_WAIT) / 2) / (window + RETRY_WAIT));
+    if (windows < 1)
+        windows = 1;
+    else if (RETRY_MAX < windows)
+        windows = RETRY_MAX;
+    retries = windows - 1;
+    if (!good && (uint32_t) (window + RETRY_WAIT) * windows <= count + RETRY_WAIT / 2)
+        retries = windows;  // The last window was not answered either.
+
+    CountUp(&stats.transactions, windows);
+    CountUp(&stats.bytes, windows * bytes);
+    CountUp(&stats.retries, retries);
+    if (!good)
+        CountUp(&stats.failures, 1);
+    if (cmd == HOS_CMD_KEYBOARD_REPORT || cmd == HOS_CMD_MOUSE_REPORT || cmd == HOS_CMD_KEYBOARD_MOUSE_REPORT)
+        CountUp(&stats.reports, 1);
+    CountUp(&link_calls, 1);
+    if (stats.longest < (uint16_t) ((uint32_t) count * 1000 / TIMER1_MSEC))
+        stats.longest = (uint16_t) ((uint32_t) count * 1000 / TIMER1_MSEC);
+    link_busy += count;
+    frac = (uint32_t) link_frac + count;
+    link_time += frac / TIMER1_MSEC;
+    link_frac = (uint16_t) (frac % TIMER1_MSEC);
+
+    if (good && HosGetStatusType() == HOS_TYPE_TSAP)
+        touched = 1;
+    return good;
+}
+
+static int8_t LinkReport(uint8_t type, uint8_t cmd, uint8_t len, const uint8_t* data)
+{
+    StartLink();
+    return StopLink(HosReport(type, cmd, len, data), cmd, len);
+}
+
+static int8_t LinkGetStatus(uint8_t type)
+{
+    StartLink();
+    return StopLink(HosGetStatus(type), HOS_CMD_GET_STATUS, 0);
+}
+
+static int8_t LinkSetEvent(uint8_t type, uint8_t key)
+{
+    StartLink();
+    return StopLink(HosSetEvent(type, key), HOS_CMD_SET_EVENT, 1);
+}
+
+static int8_t LinkSleep(uint8_t type)
+{
+    StartLink();
+    return StopLink(HosSleep(type), HOS_CMD_SET_EVENT, 1);
+}
+
+static int8_t LinkSetBatteryLevel(uint8_t type, uint8_t level)
+{
+    StartLink();
+    return StopLink(HosSetBatteryLevel(type, level), HOS_CMD_BATT_REPORT, 1);
+}
+
+void HosGetStats(HosStats* s)
+{
+    if (link_calls)
+        stats.average = (uint16_t) (link_busy * 1000 / TIMER1_MSEC / link_calls);
+    memmove(s, &stats, sizeof stats);
+    memset(&stats, 0, sizeof stats);
+    link_calls = 0;
+    link_busy = 0;
+}
+
+uint32_t HosGetLinkTime(void)
+{
+    return link_time;
+}
+
+#ifdef ENABLE_MOUSE
+static int8_t CheckTouch(void)
+{
+    int8_t updated = touched;
+
+    touched = 0;
+    return updated;
+}
+#endif
+
+static uint16_t battery_voltage;
+static uint8_t  battery_level = BATTERY_UNKNOWN;   // Level last reported to the module
+
+// Discharge curve of the alkaline cells as (voltage [1/100V], level [%])
+// breakpoints, interpolated linearly in between.
+static const uint16_t battery_curve[][2] = {
+    { 215,   0 },
+    { 230,   4 },
+    { 240,  14 },
+    { 244,  21 },
+    { 248,  40 },
+    { 252,  72 },
+    { 256,  82 },
+    { 260,  87 },
+    { 270,  95 },
+    { 280, 100 },
+};
+
+#define BATTERY_CURVE_SIZE  (sizeof battery_curve / sizeof battery_curve[0])
+
+uint16_t HosEstimateBatteryVoltage(void)
+{
+    return battery_voltage;
+}
+
+uint8_t HosEstimateBatteryLevel(void)
+{
+    uint16_t voltage = HosEstimateBatteryVoltage();
+    uint8_t i;
+
+    if (voltage <= battery_curve[0][0])
+        return 0u;
+    for (i = 1; i < BATTERY_CURVE_SIZE; ++i) {
+        if (voltage < battery_curve[i][0]) {
+            uint16_t v0 = battery_curve[i - 1][0];
+            uint16_t l0 = battery_curve[i - 1][1];
+            return (uint8_t) (l0 + (voltage - v0) * (battery_curve[i][1] - l0) / (battery_curve[i][0] - v0));
+        }
+    }
+    return 100u;
+}
+
+// Update the battery voltage estimate with the voltage reported by the
+// module. Samples taken while reports are being sent are compensated for
+// the sag and weighted less. The level is reported to the module only when
+// it has moved by BATTERY_HYSTERESIS, or reached 0 or 100%.
+static uint8_t HosUpdateBatteryLevel(int8_t loaded)
+{
+    int8_t good = 1;
+
+    uint16_t v = HosGetBatteryReading();
+    if (loaded) {
+        // 0.875 * prev + (1 - 0.875) * (current + sag)
+        v += BATTERY_LOAD_SAG;
+        if (battery_voltage)
+            battery_voltage += (v >> 3) - (battery_voltage >> 3);
+        else
+            battery_voltage = v;
+    } else {
+        uint16_t diff = (battery_voltage < v) ? (v - battery_voltage) : (battery_voltage - v);
+        if (50 < diff) {
+            battery_voltage = v;    // The batteries have been replaced.
+        } else {
+            // Apply low pass filter:
+            // 0.75 * prev + (1 - 0.75) * current
+            battery_voltage += (v >> 2) - (battery_voltage >> 2);
+        }
+    }
+
+    uint8_t level = HosEstimateBatteryLevel();
+    if (battery_level == BATTERY_UNKNOWN ||
+        level + BATTERY_HYSTERESIS <= battery_level || battery_level + BATTERY_HYSTERESIS <= level ||
+        level != battery_level && (level == 0 || level == 100))
+    {
+        good = LinkSetBatteryLevel(HOS_TYPE_DEFAULT, level);
+        if (good)
+            battery_level = level;
+    }
+    return good;
+}
+
+// LED blink patterns
+typedef struct LEDPattern {
+    uint16_t on;    // [msec] 0 to keep the LEDs off
+    uint16_t off;   // [msec]
+} LEDPattern;
+
+#define LED_PATTERN_OFF                 0
+#define LED_PATTERN_ADVERTISING         1
+#define LED_PATTERN_WHITELIST           2
+#define LED_PATTERN_SLOW                3
+#define LED_PATTERN_DIRECTED            4
+#define LED_PATTERN_BONDING             5
+#define LED_PATTERN_DFU                 6
+#define LED_PATTERN_NONE                0xffu   // The LEDs are controlled elsewhere.
+
+static const LEDPattern led_patterns[] = {
+    { 0, 0 },
+    { ADVERTISING_LED_ON_INTERVAL, ADVERTISING_LED_OFF_INTERVAL },
+    { ADVERTISING_WHITELIST_LED_ON_INTERVAL, ADVERTISING_WHITELIST_LED_OFF_INTERVAL },
+    { ADVERTISING_SLOW_LED_ON_INTERVAL, ADVERTISING_SLOW_LED_OFF_INTERVAL },
+    { ADVERTISING_DIRECTED_LED_ON_INTERVAL, ADVERTISING_DIRECTED_LED_OFF_INTERVAL },
+    { BONDING_INTERVAL, BONDING_INTERVAL },
+    { DFU_LED_ON_INTERVAL, DFU_LED_OFF_INTERVAL },
+};
+
+static LED      led_current = LED_NONE;
+static uint8_t  led_pattern = LED_PATTERN_NONE;
+static int8_t   led_lit;
+static int16_t  led_left;       // [msec] Time left until the LED is toggled
+static uint16_t led_tick;
+
+static void StartLEDPattern(LED led, uint8_t pattern)
+{
+    if (led_current != LED_NONE)
+        LED_Off(led_current);
+    led_current = led;
+    led_pattern = pattern;
+    led_left = led_patterns[pattern].on;
+    led_lit = led_left && led != LED_NONE;
+    if (led_lit) {
+        LED_On(led);
+    } else {
+        LED_Off(LED_D1);
+        LED_Off(LED_D2);
+        LED_Off(LED_D3);
+    }
+}
+
+// Advance the current pattern by msec. The LED is only touched at the edges.
+static void RunLEDPattern(uint16_t msec)
+{
+    const LEDPattern* p = &led_patterns[led_pattern];
+
+    if (!p->on || led_current == LED_NONE)
+        return;
+    led_left -= msec;
+    while (led_left <= 0) {
+        if (led_lit) {
+            LED_Off(led_current);
+            led_left += p->off;
+        } else {
+            LED_On(led_current);
+            led_left += p->on;
+        }
+        led_lit = !led_lit;
+    }
+}
+
+// Show the pattern on the LED. The pattern restarts when the pattern, the
+// LED, or tick changes otherwise than by counting up.
+static void ShowLEDPattern(LED led, uint8_t pattern, uint16_t tick)
+{
+    if (led != led_current || pattern != led_pattern || tick < led_tick)
+        StartLEDPattern(led, pattern);
+    else
+        RunLEDPattern((tick - led_tick) * (1000 / WDT_FREQ));
+    led_tick = tick;
+}
+
+// Indicate the link state on the profile LED.
+static void UpdateLED(LED led, uint16_t tick)
+{
+    uint8_t pattern = LED_PATTERN_OFF;
+
+    if (led != LED_NONE) {
+        switch (HosGetIndication()) {
+        case HOS_BLE_STATE_SCANNING:
+        case HOS_BLE_STATE_ADVERTISING:
+            pattern = LED_PATTERN_ADVERTISING;
+            break;
+        case HOS_BLE_STATE_ADVERTISING_WHITELIST:
+            pattern = LED_PATTERN_WHITELIST;
+            break;
+        case HOS_BLE_STATE_ADVERTISING_SLOW:
+            pattern = LED_PATTERN_SLOW;
+            break;
+        case HOS_BLE_STATE_ADVERTISING_DIRECTED:
+            pattern = LED_PATTERN_DIRECTED;
+            break;
+        case HOS_BLE_STATE_BONDING:
+            pattern = LED_PATTERN_BONDING;
+            break;
+        case HOS_BLE_STATE_CONNECTED:
+            led_pattern = LED_PATTERN_NONE;
+            return;
+        default:
+            break;
+        }
+    }
+    ShowLEDPattern(led, pattern, tick);
+}
+
+//
+// Energy accounting: the time spent in each power state is combined with
+// the supply current of that state into a charge estimate.
+//
+
+// Supply current in each power state [uA]: active at 48 MHz, LinkReport(),
+// Idle mode, Sleep, suspended at 125 kHz, and per LED lit. These are rough
+// figures; measure the board and override them.
+#ifndef HOS_CURRENT_TABLE
+#define HOS_CURRENT_TABLE   { 13000, 13500, 6000, 20, 25, 1500 }
+#endif
+
+static const uint16_t currents[] = HOS_CURRENT_TABLE;
+
+static struct {
+    uint32_t active;            // [msec] Awake at 48 MHz including LinkReport()
+    uint32_t idle;              // [msec]
+    uint32_t sleep;             // [tick]
+    uint32_t suspend;           // [tick]
+    uint32_t led;               // [tick] Summed over the LEDs lit
+    uint16_t keys;              // Keystrokes
+} energy;
+
+static uint16_t timer_last;
+static uint16_t timer_frac;     // [Timer1 count] Less than a msec, yet to be added to energy.active
+static uint8_t  leds_lit;
+static uint8_t  keys_down;
+
+static void AccountActive(void)
+{
+    uint16_t now = ReadTimer1();
+    uint32_t count = (uint32_t) timer_frac + (uint16_t) (now - timer_last);
+
+    // Fold the count into msec right away, as a 32-bit Timer1 count would
+    // wrap after 48 minutes awake.
+    energy.active += count / TIMER1_MSEC;
+    timer_frac = (uint16_t) (count % TIMER1_MSEC);
+    timer_last = now;
+}
+
+static void CountKeystrokes(const uint8_t* keyboard_report)
+{
+    uint8_t down = 0;
+
+    for (uint8_t i = 2; i < 8; ++i) {
+        if (keyboard_report[i])
+            ++down;
+    }
+    if (keys_down < down) {
+        if (energy.keys < 0xffff - (down - keys_down))
+            energy.keys += down - keys_down;
+        else
+            energy.keys = 0xffff;
+    }
+    keys_down = down;
+}
+
+static uint32_t TicksToMsec(uint32_t ticks, uint16_t freq)
+{
+    return ticks / freq * 1000 + ticks % freq * 1000 / freq;
+}
+
+// [uC] i.e. [uA sec]
+static uint32_t Charge(uint16_t current, uint32_t msec)
+{
+    return current * (msec / 1000) + current * (msec % 1000) / 1000;
+}
+
+void HosGetEnergy(HosEnergy* e)
+{
+    uint32_t active = energy.active;
+    uint32_t spi = HosGetLinkTime();
+    uint32_t idle = energy.idle;
+    uint32_t sleep = TicksToMsec(energy.sleep, WDT_FREQ);
+    uint32_t suspend = TicksToMsec(energy.suspend, WDT_FREQ);
+    uint32_t total;
+    uint32_t charge;
+
+    if (active < spi)
+        spi = active;
+    active -= spi;
+    total = active + spi + idle + sleep + suspend;
+    charge = Charge(currents[0], active) + Charge(currents[1], spi) + Charge(currents[2], idle) +
+             Charge(currents[3], sleep) + Charge(currents[4], suspend) +
+             Charge(currents[5], TicksToMsec(energy.led, WDT_FREQ));
+
+    e->minutes = (uint16_t) (total / 60000);
+    e->average = (1000 <= total) ? (uint16_t) (charge / (total / 1000)) : 0;
+    e->perKey = energy.keys ? (uint16_t) ((charge / energy.keys < 0xffff) ? charge / energy.keys : 0xffff) : 0;
+    e->keys = energy.keys;
+}
+
+// Lower the clock frequency to extend battery life, and sleep until a key is
+// pressed. The watchdog timer wakes the PIC every tick just to probe the
+// matrix, which costs much less at 125kHz than at 48MHz.
+static void WaitForResume(void)
+{
+    APP_LEDUpdate(0);
+    AccountActive();
+    FlushNvram();
+
+    WDTCONbits.REGSLP = 1;
+    APP_Suspend();
+
+    while (!BUTTON_IsPressed()) {
+        Sleep();
+        Nop();
+        ++energy.suspend;
+    }
+
+    APP_WakeFromSuspend();
+    timer_last = ReadTimer1();
+}
+
+#define LINK_SYNCING    0xffu   // Waiting for the BLE module to switch to the current profile
+#define LINK_DFU        0xfeu   // Waiting for the BLE module to come back from its bootloader
+#define QUEUE_SIZE      8       // Keyboard reports kept while switching hosts
+
+static uint16_t tick;           // Ticks since the link state was last reset
+static uint8_t  elapsed;        // Ticks since the tasks last ran
+static uint8_t  link = HOS_BLE_STATE_IDLE;
+static int8_t   starting = 1;
+static uint8_t  status_active;  // Ticks left to poll the status every tick
+static uint8_t  status_poll;    // Ticks left until the next fallback status poll
+static uint16_t quiet;          // Ticks since the keyboard or the pad was last active
+
+static uint16_t starting_up;    // Ticks left to wait for the first status from the BLE module
+static bool     dfu_request;    // Send HOS_EVENT_DFU once the BLE module answers
+static uint8_t  sync_wait;      // Ticks to wait for the module to restart before sending the event again
+static uint8_t  queue[QUEUE_SIZE][8];
+static uint8_t  queued;
+static uint16_t queue_ttl;      // Ticks left to keep the keys typed for the new host
+
+// Switch the BLE module to another host. The profile is selected at once so
+// that the settings changed from now on go to the new one, and the event is
+// sent by the next HosKeyboardTask() run. The flash write is left to
+// PollNvram(), so that neither it nor the module restart stalls typing.
+void HosSelectProfile(uint8_t profile)
+{
+    if (CurrentProfile() != profile) {
+        SelectProfile(profile);
+        sync_wait = 0;
+        queued = 0;
+        queue_ttl = HOS_SWITCH_TIMEOUT;
+    }
+}
+
+static void QueueReport(const uint8_t* keyboard_report)
+{
+    if (queued < QUEUE_SIZE)
+        ++queued;
+    memmove(queue[queued - 1], keyboard_report, 8);   // Keep the latest state when full.
+}
+
+// Send the reports typed while switching hosts. The reports not accepted are
+// kept for the next tick.
+static void FlushReports(void)
+{
+    uint8_t sent = 0;
+
+    while (sent < queued && LinkReport(HOS_TYPE_DEFAULT, HOS_CMD_KEYBOARD_REPORT, 8, queue[sent]))
+        ++sent;
+    queued -= sent;
+    memmove(queue[0], queue[sent], queued * 8);
+}
+
+// Count down a timer by the ticks elapsed since the tasks last ran, which
+// is more than one in the slow idle mode.
+static uint16_t Elapse(uint16_t left)
+{
+    return (elapsed < left) ? left - elapsed : 0;
+}
+
+static void HosPollStatus(void)
+{
+    if (status_active) {
+        status_active = Elapse(status_active);
+    } else if (elapsed < status_poll) {
+        status_poll -= elapsed;
+        return;
+    }
+    status_poll = STATUS_POLL_INTERVAL;
+#ifdef ENABLE_MOUSE
+    if (quiet < HOS_IDLE_DELAY)
+        status_poll = PAD_POLL_INTERVAL;
+#endif
+    LinkGetStatus(HOS_TYPE_DEFAULT);
+}
+
+#ifdef ENABLE_MOUSE
+static uint8_t mouse_report[4];
+static uint8_t mouse_clock;     // [1/WDT_FREQ msec] Time yet to be given to tickMouseReport()
+#endif
+
+// Send the pending reports in as few transactions as the BLE module allows.
+// The status piggybacks on the response, so it is polled only if nothing is
+// sent. The motion is taken from the accumulators only once the module has
+// accepted it. Return 0 if the keyboard report was not accepted, so that the
+// caller can keep it.
+static int8_t HosSendReports(const uint8_t* keyboard_report)
+{
+#ifdef ENABLE_MOUSE
+    if (isMouseReportDue()) {
+        // Take the motion accumulated until now so that none of it is lost
+        // if several TSAP samples came in since the last report.
+        mouse_report[0] = getKeyboardMouseButtons();
+        mouse_report[1] = getKeyboardMouseX();
+        mouse_report[2] = getKeyboardMouseY();
+        mouse_report[3] = getKeyboardMouseWheel();
+        status_poll = STATUS_POLL_INTERVAL;
+        if (keyboard_report && HOS_VERSION_KEYBOARD_MOUSE_REPORT <= HosGetVersion()) {
+            uint8_t report[8 + sizeof mouse_report];
+
+            memmove(report, keyboard_report, 8);
+            memmove(report + 8, mouse_report, sizeof mouse_report);
+            status_active = STATUS_ACTIVE;
+            if (!LinkReport(HOS_TYPE_DEFAULT, HOS_CMD_KEYBOARD_MOUSE_REPORT, sizeof report, report))
+                return 0;
+            sentKeyboardMouse((int8_t) mouse_report[1], (int8_t) mouse_report[2], (int8_t) mouse_report[3]);
+            return 1;
+        }
+        if (LinkReport(HOS_TYPE_DEFAULT, HOS_CMD_MOUSE_REPORT, sizeof mouse_report, mouse_report))
+            sentKeyboardMouse((int8_t) mouse_report[1], (int8_t) mouse_report[2], (int8_t) mouse_report[3]);
+        if (!keyboard_report)
+            return 1;
+    }
+#endif
+    if (keyboard_report) {
+        status_poll = STATUS_POLL_INTERVAL;
+        status_active = STATUS_ACTIVE;  // Catch the LED report from the host.
+        return LinkReport(HOS_TYPE_DEFAULT, HOS_CMD_KEYBOARD_REPORT, 8, keyboard_report);
+    }
+    HosPollStatus();
+    return 1;
+}
+
+// Save the module version so that the features it supports are known from
+// the first transaction after the next power-on. The version belongs to the
+// module, not to a host, so it is kept in the global area of the NVRAM.
+static void CacheInfo(void)
+{
+    uint16_t version = HosGetVersion();
+
+    WriteGlobalNvram(NVRAM_GLOBAL_HOS_VERSION_MAJOR, (uint8_t) (version >> 8));
+    WriteGlobalNvram(NVRAM_GLOBAL_HOS_VERSION_MINOR, (uint8_t) version);
+}
+
+static void LoadInfo(void)
+{
+    if (HosGetVersion() == 0) {
+        HosSetVersion((ReadGlobalNvram(NVRAM_GLOBAL_HOS_VERSION_MAJOR) << 8) |
+                      ReadGlobalNvram(NVRAM_GLOBAL_HOS_VERSION_MINOR));
+    }
+}
+
+// Scan the matrix, keep the BLE module on the current profile, and send the keyboard
+// report according to the link state.
+static void HosKeyboardTask(void)
+{
+    uint8_t* keyboard_report = APP_KeyboardScan();
+
+    if (keyboard_report)
+        CountKeystrokes(keyboard_report);
+    if (isUSBMode()) {
+        if (isBusPowered()) {
+            FlushNvram();
+            LinkGetStatus(HOS_TYPE_INFO);  // Get info after reset.
+            Reset();
+            Nop();
+            Nop();
+            // NOT REACHED HERE
+        }
+    }
+
+    if (link == LINK_DFU) {
+        // The keys typed meanwhile have no link to go to.
+        if (LinkGetStatus(HOS_TYPE_INFO)) {
+            CacheInfo();
+            StartLEDPattern(LED_NONE, LED_PATTERN_OFF);
+            tick = 0;   // Reset
+            link = LINK_SYNCING;
+        }
+        return;
+    }
+
+    if (starting_up) {
+        // Keep scanning while the BLE module boots.
+        if (keyboard_report)
+            QueueReport(keyboard_report);
+        if (LinkGetStatus(HOS_TYPE_INFO)) {
+            CacheInfo();
+            if (!dfu_request) {
+                starting_up = 0;
+            } else if (LinkSetEvent(HOS_TYPE_INFO, HOS_EVENT_DFU)) {
+                starting_up = 0;
+                queued = 0;
+                link = LINK_DFU;
+                return;
+            }
+        } else if (!(starting_up = Elapse(starting_up))) {
+            // The module has not answered at all; it is likely to be
+            // still in its bootloader for an update.
+            queued = 0;
+            link = LINK_DFU;
+            return;
+        }
+        link = LINK_SYNCING;
+        return;
+    }
+
+    if (HosGetProfile() != CurrentProfile()) {
+        if (keyboard_report && queue_ttl)
+            QueueReport(keyboard_report);
+        if (sync_wait) {
+            // Keep scanning while the module restarts.
+            sync_wait = Elapse(sync_wait);
+            LinkGetStatus(HOS_TYPE_DEFAULT);
+        } else {
+            LinkSetEvent(HOS_TYPE_DEFAULT, HOS_EVENT_KEY_0 + CurrentProfile());
+            APP_LEDUpdate(CurrentProfile() ? 1u << (CurrentProfile() - 1) : 0);    // No LED for profile 0
+            sync_wait = HOS_SYNC_DELAY;
+        }
+        tick = 0;   // Reset
+        link = LINK_SYNCING;
+        return;
+    }
+
+    if (queue_ttl) {
+        queue_ttl = Elapse(queue_ttl);
+        if (!queue_ttl)
+            queued = 0;     // The new host did not show up in time.
+    }
+
+    link = HosGetIndication();
+    switch (link) {
+    case HOS_BLE_STATE_IDLE:
+        if (keyboard_report && queue_ttl)
+            QueueReport(keyboard_report);
+        if (keyboard_report || starting) {
+            starting = 1;
+            tick = 0;   // Reset
+            LinkGetStatus(HOS_TYPE_DEFAULT);
+        }
+        break;
+
+    case HOS_BLE_STATE_ADVERTISING:
+    case HOS_BLE_STATE_ADVERTISING_WHITELIST:
+    case HOS_BLE_STATE_ADVERTISING_SLOW:
+    case HOS_BLE_STATE_ADVERTISING_DIRECTED:
+        starting = 0;
+        if (keyboard_report && queue_ttl)
+            QueueReport(keyboard_report);
+        LinkGetStatus(HOS_TYPE_DEFAULT);     // Catch the connection right away.
+        // A new bonding process can be interrupted if there are pre-bonded peers that are active.
+        // In such a case, the BLE module timers are also reset, and we must manually stop
+        // advertising if a new bonding cannot be made within a reasonable time.
+        if (HOS_ADV_TIMEOUT < tick) {
+            LinkSleep(HOS_TYPE_DEFAULT);
+        }
+        break;
+
+    case HOS_BLE_STATE_BONDING:
+        if (keyboard_report) {
+            // Send HOS_CMD_KEYBOARD_REPORT anyway to support passkey entry.
+            LinkReport(HOS_TYPE_DEFAULT, HOS_CMD_KEYBOARD_REPORT, 8, keyboard_report);
+        } else {
+            LinkGetStatus(HOS_TYPE_DEFAULT);
+        }
+        break;
+
+    case HOS_BLE_STATE_CONNECTED:
+        if (queued) {
+            FlushReports();
+            if (queued && keyboard_report) {
+                QueueReport(keyboard_report);   // Keep the order.
+                keyboard_report = NULL;
+            }
+        }
+        if (!queued)
+            queue_ttl = 0;
+        if (!HosSendReports(keyboard_report))
+            QueueReport(keyboard_report);   // Send it again at the next tick.
+        break;
+
+    default:
+        FlushNvram();
+        APP_LEDUpdate(LED_NUM_LOCK | LED_CAPS_LOCK | LED_SCROLL_LOCK);
+        LinkGetStatus(HOS_TYPE_INFO);  // Get info after reset.
+        Reset();
+        Nop();
+        Nop();
+        // NOT REACHED HERE
+        break;
+    }
+}
+
+#ifdef ENABLE_MOUSE
+// Take in the latest TSAP sample. The mouse report is made and sent by
+// HosSendReports() together with the keyboard report once it is due.
+static void HosMouseTask(void)
+{
+    uint16_t clock = mouse_clock + elapsed * 1000u;  // [1/WDT_FREQ msec]
+
+    // Carry the fraction of a msec so that the wheel speed follows the time.
+    mouse_clock = clock % WDT_FREQ;
+    tickMouseReport((uint8_t) (clock / WDT_FREQ));
+    if (link != HOS_BLE_STATE_CONNECTED || !CheckTouch())
+        return;
+
+    processMouseData();
+    if (isMouseTouched() || getKeyboardMouseX() || getKeyboardMouseY())
+        status_active = STATUS_ACTIVE;
+}
+#endif
+
+static void HosLEDTask(void)
+{
+    switch (link) {
+    case LINK_SYNCING:
+        break;
+    case LINK_DFU:
+        ShowLEDPattern(LED_D3, LED_PATTERN_DFU, tick);
+        leds_lit = led_lit;
+        break;
+    case HOS_BLE_STATE_CONNECTED: {
+        uint8_t led = controlLED(HosGetLED());
+        led_pattern = LED_PATTERN_NONE;
+        APP_LEDUpdate(led);
+        for (leds_lit = 0; led; led &= led - 1)
+            ++leds_lit;
+        break;
+    }
+    default:
+        UpdateLED(CurrentProfile(), tick);
+        leds_lit = led_lit;
+        break;
+    }
+}
+
+static void HosBatteryTask(void)
+{
+    if (link == HOS_BLE_STATE_CONNECTED)
+        HosUpdateBatteryLevel(status_active != 0);
+}
+
+// Wait in Idle mode for a scan interval using Timer1. The watchdog timer is
+// cleared by entering Idle mode, so it does not expire meanwhile.
+static void HosIdleScan(void)
+{
+    uint8_t gie = INTCONbits.GIE;
+
+    AccountActive();
+    TMR1H = (uint8_t) ((0x10000 - SCAN_TIME) >> 8);
+    TMR1L = (uint8_t) (0x10000 - SCAN_TIME);
+    PIR1bits.TMR1IF = 0;
+    PIE1bits.TMR1IE = 1;
+    INTCONbits.GIE = 0;             // Wake up without vectoring.
+    OSCCONbits.IDLEN = 1;
+    Sleep();
+    Nop();
+    OSCCONbits.IDLEN = 0;
+    PIE1bits.TMR1IE = 0;
+    PIR1bits.TMR1IF = 0;
+    INTCONbits.GIE = gie;
+    timer_last = ReadTimer1();
+    energy.idle += APP_KEYBOARD_SCAN_MSEC;
+}
+
+// Suspend while the link is down. The key that resumes the keyboard is kept
+// in the queue until the link is back.
+static void HosSuspendTask(void)
+{
+    if (link != LINK_SYNCING && link != LINK_DFU && !(queued && queue_ttl) && (HosGetSuspended() || link == HOS_BLE_STATE_IDLE)) {
+        WaitForResume();
+
+        // Capture the key right away. The keyboard core reports a key after
+        // it has been seen by two scans past the delay, so scan at the USB
+        // interval until then.
+        uint8_t* keyboard_report = APP_KeyboardScan();
+        for (uint8_t i = 0; !keyboard_report && i < DELAY_MAX + 1; ++i) {
+            HosIdleScan();
+            keyboard_report = APP_KeyboardScan();
+        }
+        queue_ttl = HOS_RESUME_TIMEOUT;
+        if (keyboard_report) {
+            CountKeystrokes(keyboard_report);
+            QueueReport(keyboard_report);
+        }
+    }
+}
+
+static Task tasks[] = {
+#ifdef ENABLE_MOUSE
+    TASK(HosMouseTask, 1, HOS_IDLE_TICKS),
+#endif
+    TASK(HosKeyboardTask, 1, HOS_IDLE_TICKS),
+    TASK(HosLEDTask, 1, HOS_IDLE_TICKS),
+    TASK(HosBatteryTask, BATTERY_LEVEL_MEAS_INTERVAL, WDT_FREQ),
+    TASK(HosSuspendTask, 1, HOS_IDLE_TICKS),
+    TASK(PollNvram, 1, HOS_IDLE_TICKS),
+};
+
+#define TASK_COUNT  (sizeof tasks / sizeof tasks[0])
+
+static uint16_t scan_time;      // [Timer1 count] Time scanned in Idle mode since the last tick
+
+// Sleep until the next tick and return the number of ticks elapsed. While
+// connected, the matrix is scanned every APP_KEYBOARD_SCAN_MSEC as over USB
+// shortly after activity, so that the delays and the debounce counted in
+// scans keep their length while keys are held. The tasks take the scan
+// that falls on a tick. After a long inactivity, the matrix is scanned only
+// every HOS_IDLE_TICKS ticks, or earlier if a task would miss its deadline
+// by slack. No key is held then, and a key press is still detected at every
+// watchdog wake-up.
+static uint8_t HosWait(uint8_t slack)
+{
+    uint8_t ticks = 1;
+
+    AccountActive();
+    if (link != HOS_BLE_STATE_CONNECTED || status_active || BUTTON_IsPressed())
+        quiet = 0;
+
+    if (link != HOS_BLE_STATE_CONNECTED || HOS_ACTIVE_DELAY <= quiet && quiet < HOS_IDLE_DELAY) {
+        Sleep();
+        Nop();
+        ++energy.sleep;
+    } else if (quiet < HOS_ACTIVE_DELAY) {
+        for (;;) {
+            HosIdleScan();
+            scan_time += SCAN_TIME;
+            if (TICK_TIME <= scan_time) {
+                scan_time -= TICK_TIME;
+                break;
+            }
+            uint8_t* keyboard_report = APP_KeyboardScan();
+            if (keyboard_report) {
+                CountKeystrokes(keyboard_report);
+                if (queued || !HosSendReports(keyboard_report))
+                    QueueReport(keyboard_report);
+            }
+        }
+    } else {
+        for (ticks = 0; ticks < HOS_IDLE_TICKS && ticks < slack;) {
+            Sleep();
+            Nop();
+            ++ticks;
+            if (BUTTON_IsPressed()) {
+                quiet = 0;
+                break;
+            }
+        }
+        energy.sleep += ticks;
+    }
+    energy.led += leds_lit * ticks;
+    if (quiet < 0xffff - ticks)
+        quiet += ticks;
+    return ticks;
+}
+
+uint8_t HosGetMissed(void)
+{
+    return missedTasks(tasks, TASK_COUNT);
+}
+
+// Run the keyboard over the BLE module until the USB bus power comes up.
+// With dfu, the module is switched to its bootloader once it answers. While
+// the module is silent, the keyboard is scanned and D3 is kept blinking.
+void HosRunTasks(bool dfu)
+{
+    if (isUSBMode() && isBusPowered())
+        return;
+
+    // Save ~0.5mA
+    PMDIS0 = 0xfb;
+    PMDIS1 = 0xfc;  // Keep Timer1 to time the fast scan and the energy use.
+    PMDIS2 = 0x5f;
+    PMDIS3 = 0xfe;
+    T1CON = 0x33;   // Fosc/4, 1:8, 16-bit read/write, on
+    timer_last = ReadTimer1();
+
+    // Enable watchdog timer
+    WDTCONbits.REGSLP = 1;
+    WDTCONbits.SWDTEN = 1;
+
+    LED_Off(LED_D1);
+    LED_Off(LED_D2);
+    LED_Off(LED_D3);
+
+    // Start scanning right away. HosKeyboardTask() waits for the first
+    // status from the BLE module, and keeps the keys typed meanwhile.
+    LoadInfo();
+    starting_up = HOS_STARTUP_DELAY;
+    dfu_request = dfu;
+    queue_ttl = HOS_RESUME_TIMEOUT;
+    sync_wait = HOS_SYNC_DELAY;     // Let the module settle on its own profile first.
+
+    uint8_t slack;
+#ifdef ENABLE_MOUSE
+    setMouseReportInterval(MOUSE_REPORT_INTERVAL_HOS);
+    setMouseMotionLimit(MOUSE_MOTION_MAX);  // HOS reports carry 8-bit motion.
+#endif
+    initTasks(tasks, TASK_COUNT);
+    for (tick = 0;; tick += elapsed) {
+        slack = runTasks(tasks, TASK_COUNT, elapsed);
+        elapsed = HosWait(slack);
+    }
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2026 Esrille Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOS_TASKS_H
+#define HOS_TASKS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// HosTasks.c runs the keyboard over the BLE module with the HID over SPI
+// transactions of HosMaster.c, which is kept as qualified. HosLink.c builds
+// HosMaster.c with the accessors below.
+//
+
+// Sent only to module versions from HOS_VERSION_KEYBOARD_MOUSE_REPORT on.
+// The module answers every command with its status, so a command it does
+// not know is dropped without notice. The released modules are older, and
+// get the keyboard and mouse reports separately.
+#define HOS_CMD_KEYBOARD_MOUSE_REPORT       0xF6    // 8-byte keyboard report followed by 4-byte mouse report
+#define HOS_VERSION_KEYBOARD_MOUSE_REPORT   0x0200u
+
+#define HOS_SWITCH_TIMEOUT  (WDT_FREQ * 5u)     // Keep the keys typed while switching hosts for up to 5 sec.
+#define HOS_RESUME_TIMEOUT  (WDT_FREQ * 5u)     // Keep the keys typed after resume for up to 5 sec.
+
+// Scan rate while connected
+#define HOS_ACTIVE_DELAY    (WDT_FREQ / 2u)     // Scan every APP_KEYBOARD_SCAN_MSEC until 0.5 sec after the last activity.
+#define HOS_IDLE_DELAY      (WDT_FREQ * 5u)     // Scan every HOS_IDLE_TICKS ticks after 5 sec without activity.
+#define HOS_IDLE_TICKS      4u
+
+// SPI link statistics since the last HosGetStats() call. HosMaster.c does not
+// count the windows, so they are estimated from the duration of each call.
+typedef struct HosStats {
+    uint16_t transactions;  // Chip select windows including retries
+    uint16_t bytes;         // Bytes clocked out
+    uint16_t retries;       // Windows answered with HOS_DEF_CHARACTER
+    uint16_t failures;      // Calls that returned 0
+    uint16_t reports;       // HOS_CMD_KEYBOARD_REPORT and HOS_CMD_MOUSE_REPORT calls
+    uint16_t average;       // [usec] Mean call duration including retries
+    uint16_t longest;       // [usec] Longest call duration
+} HosStats;
+
+// Energy estimate since HosRunTasks() started
+typedef struct HosEnergy {
+    uint16_t minutes;       // Time measured
+    uint16_t average;       // [uA] Mean supply current, i.e. [uAh] per hour
+    uint16_t perKey;        // [uC] Charge per keystroke
+    uint16_t keys;          // Keystrokes
+} HosEnergy;
+
+// HosLink.c
+uint16_t HosGetBatteryReading(void);    // [1/100V] Last voltage reported by the module
+uint8_t HosGetStatusType(void);         // HOS_TYPE_* of the last status received
+void HosSetVersion(uint16_t version);
+
+void HosRunTasks(bool dfu);
+void HosSelectProfile(uint8_t profile);
+uint16_t HosEstimateBatteryVoltage(void);   // [1/100V]
+uint8_t HosEstimateBatteryLevel(void);      // [%]
+void HosGetStats(HosStats* stats);
+uint32_t HosGetLinkTime(void);          // [msec] Total time spent in HosMaster.c calls
+void HosGetEnergy(HosEnergy* energy);
+uint8_t HosGetMissed(void);     // Task runs that started past their deadline since the last call
+
+#endif  // HOS_TASKS_H
@@ -517,6 +517,10 @@
 #define EEPROM_MOUSE    7
 #define EEPROM_PREFIX   8
 
+// Offsets in the NVRAM area shared by all the profiles
+#define NVRAM_GLOBAL_HOS_VERSION_MAJOR  0   // Version of the BLE module last seen
+#define NVRAM_GLOBAL_HOS_VERSION_MINOR  1
+
 void initKeyboard(void);
 void initKeyboardBase(void);
 void initKeyboardKana(void);
@@ -166,6 +166,64 @@ static uint8_t modFn;
 static uint8_t dualFn;  // Used for dual-role FN keys
 #endif
 
+#ifdef ENABLE_SCAN_PROFILE
+//
+// Scan profiling: Timer3 counts instruction cycles (Fosc/4) spent in
+// makeReport() so that the worst case can be read out via the F1 dump.
+//
+#ifndef SCAN_BUDGET
+#define SCAN_BUDGET     12000u  // [Tcy] 1 msec at 48 MHz
+#endif
+
+static uint16_t scanMax;        // [Tcy]
+static uint16_t scanOverrun;    // Number of scans that exceeded SCAN_BUDGET
+
+static void initScanTimer(void)
+{
+    T3CON = 0;                  // Fosc/4, 1:1 prescale
+    T3CONbits.RD16 = 1;
+}
+
+static void initScanProfile(void)
+{
+    initScanTimer();
+    scanMax = 0;
+    scanOverrun = 0;
+}
+
+static void beginScanProfile(void)
+{
+#if APP_MACHINE_VALUE != 0x4550
+    if (PMDIS1bits.TMR3MD) {
+        // The BLE loop powers down the peripherals it does not use, which
+        // resets Timer3.
+        PMDIS1bits.TMR3MD = 0;
+        initScanTimer();
+    }
+#endif
+    T3CONbits.TMR3ON = 0;
+    TMR3H = 0;
+    TMR3L = 0;
+    PIR2bits.TMR3IF = 0;
+    T3CONbits.TMR3ON = 1;
+}
+
+static void endScanProfile(void)
+{
+    uint16_t cycles;
+
+    T3CONbits.TMR3ON = 0;
+    cycles = TMR3L;
+    cycles |= (uint16_t) TMR3H << 8;
+    if (PIR2bits.TMR3IF)
+        cycles = 0xffff;        // Saturate on overflow
+    if (scanMax < cycles)
+        scanMax = cycles;
+    if (SCAN_BUDGET < cycles && scanOverrun < 0xffff)
+        ++scanOverrun;
+}
+#endif
+
 void initKeyboard(void)
 {
     memset(keys, VOID_KEY, sizeof keys);
@@ -190,6 +248,9 @@ void initKeyboard(void)
         prefix_shift = 0;
     initKeyboardBase();
     initKeyboardKana();
+#ifdef ENABLE_SCAN_PROFILE
+    initScanProfile();
+#endif
 }
 
 void emitOSName(void)
@@ -295,11 +356,25 @@ static int8_t detectGhost(void)
     return detected;
 }
 
+static void endMacro(void)
+{
+    ordered_pos = 0;
+    ordered_max = 0;
+}
+
 uint8_t beginMacro(uint8_t max)
 {
+    uint8_t key = ordered_keys[0];
+
+    if (!key) {
+        endMacro();
+        return 0;
+    }
+    if (sizeof ordered_keys < max)
+        max = sizeof ordered_keys;
     ordered_pos = 1;
     ordered_max = max;
-    return ordered_keys[0];
+    return key;
 }
 
 uint8_t peekMacro(void)
@@ -311,22 +386,24 @@ uint8_t peekMacro(void)
 
 uint8_t getMacro(void)
 {
-    if (ordered_max <= ordered_pos)
-        return 0;
-    uint8_t key = ordered_keys[ordered_pos++];
-    if (key == 0) {
-        ordered_pos = 0;
-        ordered_max = 0;
-    }
+    uint8_t key = peekMacro();
+
+    // Rewind at the end of the macro, including a truncated one, so that the
+    // next emitKey() starts from the top of ordered_keys again.
+    if (key == 0)
+        endMacro();
+    else
+        ++ordered_pos;
     return key;
 }
 
 void emitKey(uint8_t c)
 {
-    if (ordered_pos < sizeof ordered_keys)
+    // Reserve the last byte for the terminating zero.
+    if (ordered_pos < sizeof ordered_keys - 1) {
         ordered_keys[ordered_pos++] = c;
-    if (ordered_pos < sizeof ordered_keys)
         ordered_keys[ordered_pos] = 0;
+    }
 }
 
 void emitString(const uint8_t s[])
@@ -339,10 +416,9 @@ void emitString(const uint8_t s[])
 
 void emitStringN(const uint8_t s[], uint8_t len)
 {
-    uint8_t i = 0;
-    uint8_t c;
-    for (c = s[i]; i < len && c; c = s[++i])
-        emitKey(c);
+    // Check len before reading s[i], since s may have no terminating zero.
+    for (uint8_t i = 0; i < len && s[i]; ++i)
+        emitKey(s[i]);
 }
 
 static uint8_t getNumKeycode(unsigned int n)
@@ -414,6 +490,24 @@ static const uint8_t about_f9[] = {
     KEY_F, KEY_9, KEY_SPACEBAR, 0
 };
 
+#if defined(ENABLE_SCAN_PROFILE) && APP_MACHINE_VALUE != 0x4550
+static const uint8_t about_scan[] = {
+    KEY_S, KEY_C, KEY_A, KEY_N, KEY_SPACEBAR, 0
+};
+
+// SCAN max/budget overrun
+static void emitScanProfile(void)
+{
+    emitString(about_scan);
+    emitNumber(scanMax);
+    emitKey(KEY_SLASH);
+    emitNumber(SCAN_BUDGET);
+    emitKey(KEY_SPACEBAR);
+    emitNumber(scanOverrun);
+    emitKey(KEY_ENTER);
+}
+#endif
+
 #ifdef WITH_HOS
 static const uint8_t about_ble[] = {
     KEY_B, KEY_L, KEY_E, KEY_SPACEBAR, KEY_M, KEY_O, KEY_D, KEY_U, KEY_L, KEY_E,
@@ -428,6 +522,64 @@ static const uint8_t about_lesc[] = {
     KEY_L, KEY_E, KEY_S, KEY_C, KEY_SPACEBAR, 0
 };
 
+static const uint8_t about_spi[] = {
+    KEY_S, KEY_P, KEY_I, KEY_SPACEBAR, 0
+};
+
+static const uint8_t about_late[] = {
+    KEY_L, KEY_A, KEY_T, KEY_E, KEY_SPACEBAR, 0
+};
+
+// SPI transactions/reports bytes retries failures average/longest [usec],
+// and LATE task runs past their deadline, counted since the last dump
+static void emitHosStats(void)
+{
+    HosStats stats;
+
+    HosGetStats(&stats);
+    emitString(about_spi);
+    emitNumber(stats.transactions);
+    emitKey(KEY_SLASH);
+    emitNumber(stats.reports);
+    emitKey(KEY_SPACEBAR);
+    emitNumber(stats.bytes);
+    emitKey(KEY_SPACEBAR);
+    emitNumber(stats.retries);
+    emitKey(KEY_SPACEBAR);
+    emitNumber(stats.failures);
+    emitKey(KEY_SPACEBAR);
+    emitNumber(stats.average);
+    emitKey(KEY_SLASH);
+    emitNumber(stats.longest);
+    emitKey(KEY_ENTER);
+
+    emitString(about_late);
+    emitNumber(HosGetMissed());
+    emitKey(KEY_ENTER);
+}
+
+static const uint8_t about_energy[] = {
+    KEY_E, KEY_N, KEY_E, KEY_R, KEY_G, KEY_Y, KEY_SPACEBAR, 0
+};
+
+// Mean current [uA] charge per keystroke [uC]/keystrokes minutes, counted
+// since the BLE loop started
+static void emitHosEnergy(void)
+{
+    HosEnergy energy;
+
+    HosGetEnergy(&energy);
+    emitString(about_energy);
+    emitNumber(energy.average);
+    emitKey(KEY_SPACEBAR);
+    emitNumber(energy.perKey);
+    emitKey(KEY_SLASH);
+    emitNumber(energy.keys);
+    emitKey(KEY_SPACEBAR);
+    emitNumber(energy.minutes);
+    emitKey(KEY_ENTER);
+}
+
 #endif
 
 static void about(void)
@@ -470,6 +622,9 @@ static void about(void)
         emitString(about_lesc);
         emitKey(getNumKeycode(HosGetLESC()));
         emitKey(KEY_ENTER);
+
+        emitHosStats();
+        emitHosEnergy();
     }
 #else
     emitString(about_copyright);
@@ -511,10 +666,14 @@ static void about(void)
     emitMouse();
 #endif
 
+#if defined(ENABLE_SCAN_PROFILE) && APP_MACHINE_VALUE != 0x4550
+    emitScanProfile();
+#endif
+
 #ifdef WITH_HOS
     if (!isBusPowered()) {
-        uint16_t voltage = HosGetBatteryVoltage();
-        uint8_t level = HosGetBatteryLevel();
+        uint16_t voltage = HosEstimateBatteryVoltage();
+        uint8_t level = HosEstimateBatteryLevel();
         if (HOS_BATTERY_VOLTAGE_OFFSET < voltage) {
             emitKey(getNumKeycode(voltage / 100));
             emitKey(KEY_PERIOD);
@@ -565,7 +724,7 @@ static int8_t processKeys(const uint8_t* current, uint8_t* processed, uint8_t* r
                     if (make) {
 #ifdef WITH_HOS
                         if (current[0] & MOD_SHIFT) {
-                            SelectProfile(1);
+                            HosSelectProfile(1);
                             modifiers &= ~(MOD_CONTROL | MOD_SHIFT);
                             xmit = XMIT_BRK;
                         }
@@ -581,7 +740,7 @@ static int8_t processKeys(const uint8_t* current, uint8_t* processed, uint8_t* r
                     if (make) {
 #ifdef WITH_HOS
                         if (current[0] & MOD_SHIFT) {
-                            SelectProfile(2);
+                            HosSelectProfile(2);
                             modifiers &= ~(MOD_CONTROL | MOD_SHIFT);
                             xmit = XMIT_BRK;
                         }
@@ -597,7 +756,7 @@ static int8_t processKeys(const uint8_t* current, uint8_t* processed, uint8_t* r
                     if (make) {
 #ifdef WITH_HOS
                         if (current[0] & MOD_SHIFT) {
-                            SelectProfile(3);
+                            HosSelectProfile(3);
                             modifiers &= ~(MOD_CONTROL | MOD_SHIFT);
                             xmit = XMIT_BRK;
                         }
@@ -613,7 +772,7 @@ static int8_t processKeys(const uint8_t* current, uint8_t* processed, uint8_t* r
                     if (make) {
 #ifdef WITH_HOS
                         if (current[0] & MOD_SHIFT) {
-                            SelectProfile(0);
+                            HosSelectProfile(0);
                             modifiers &= ~(MOD_CONTROL | MOD_SHIFT);
                             xmit = XMIT_BRK;
                         }
@@ -885,6 +1044,9 @@ int8_t makeReport(uint8_t* report)
     int8_t at;
     int8_t prev;
 
+#ifdef ENABLE_SCAN_PROFILE
+    beginScanProfile();
+#endif
     if (!detectGhost()) {
         while (count < 8)
             current[count++] = VOID_KEY;
@@ -954,6 +1116,9 @@ int8_t makeReport(uint8_t* report)
     modifiers = 0;
     current[1] = 0;
 
+#ifdef ENABLE_SCAN_PROFILE
+    endScanProfile();
+#endif
     return xmit;
 }
 
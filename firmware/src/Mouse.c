@@ -29,12 +29,23 @@ typedef struct {
 
 typedef struct {
     uint16_t current;
+    uint16_t baseline;  // Level without a touch in 1/16 units; 0 until the first sample
     uint16_t thresh;
-    uint16_t low;
+    int8_t touched;
 } TouchSensor;
 
 #define PLAY_MAX    (PAD_SENSE_MAX + 1)
 
+#define SERIAL_QUEUE_SIZE   64      // Must be a power of two; 16 frames
+
+// A touch lowers the sensor level. The level is filtered with the fast time
+// constant, and so is a rise of the baseline; the baseline follows a falling
+// level with the slow one, and only while the pad is not touched.
+#define TOUCH_FAST      1           // Time constants in samples as powers of two
+#define TOUCH_SLOW      7
+#define TOUCH_PRESS     4           // Touched at 1/16 below the baseline,
+#define TOUCH_RELEASE   5           // and released at 1/32 below.
+
 #define CODE_F1     (1*1+1)
 #define CODE_F9     8
 #define CODE_F10    9
@@ -56,6 +67,28 @@ typedef struct {
 
 #define PLAY_XY      24         // x or y value smaller than PLAY_XY should be ignored.
 
+#define ACCEL_SIZE  (128 - PLAY_XY)
+#define ACCEL_FRAC  4               // accel[] is in 1/16 counts.
+#define ACCEL_LIMIT (127 << ACCEL_FRAC)
+
+// A held wheel key scrolls one detent at once, and then after WHEEL_DELAY
+// at a speed that goes up by 1/8 detent per WHEEL_PERIOD every WHEEL_RAMP.
+// The time is taken from the report clock, so that the speed does not
+// depend on how often the matrix is scanned.
+#define WHEEL_FRAC      3           // wheel is in 1/8 detents.
+#define WHEEL_DETENT    (1 << WHEEL_FRAC)
+#define WHEEL_DELAY     240         // [msec]
+#define WHEEL_RAMP      96          // [msec]
+#define WHEEL_PERIOD    12          // [msec]
+#define WHEEL_SPEED_MAX WHEEL_DETENT
+#define WHEEL_LIMIT     (127 << WHEEL_FRAC)
+
+// Motion and scroll are coalesced into one report per interval, while a
+// change of the buttons is reported at once.
+#ifndef MOUSE_REPORT_INTERVAL
+#define MOUSE_REPORT_INTERVAL   8   // [msec]
+#endif
+
 const static uint8_t playTable[PLAY_MAX] = {
     64, 56, 48, 40
 };
@@ -65,34 +98,95 @@ static const uint8_t about[] = {
 };
 
 static uint8_t play;
-static uint8_t tick;
+static uint8_t curve;
+
+// Motion for each deflection from PLAY_XY up, for the current play and curve
+static uint16_t accel[ACCEL_SIZE];
 
 static uint8_t buttons;
-static int8_t  x;
-static int8_t  y;
-static int8_t  wheel;
+static int16_t x;               // Motion not reported yet in 1/16 counts
+static int16_t y;
+static int16_t wheel;           // Scroll not reported yet in 1/8 detents
+static int16_t motionLimit = MOUSE_MOTION_MAX << ACCEL_FRAC;  // Motion kept while reports are not sent in 1/16 counts
+static int8_t  wheelKey;        // Direction of the wheel key held
+static uint16_t wheelHeld;      // [msec]
+static uint16_t wheelRest;      // [1/8 detent * msec] Scroll less than 1/8 detent
+static uint8_t wheelClock;      // [msec] Time since the last processMouseKeys() call
+static int8_t  wheelFine;       // Report the wheel in 1/8 detents
+
+static uint8_t reportInterval = MOUSE_REPORT_INTERVAL;   // [msec]
+static uint8_t reportWait;      // [msec] Time left until motion may be reported
+static uint8_t reportedButtons;
 
 static SerialData rawData;
 static TouchSensor touchSensor;
 
+// TSAP bytes from the UART RX interrupt. Only the interrupt handler moves
+// serialHead and only the main loop moves serialTail, so no locking is needed.
+static volatile uint8_t serialQueue[SERIAL_QUEUE_SIZE];
+static volatile uint8_t serialHead;
+static volatile uint8_t serialTail;
+static volatile uint8_t serialOverruns; // Bytes lost by the UART or the queue
+static uint8_t serialResyncs;           // Incomplete frames dropped
+
+// Fill accel[] with f(v) = v/p * ((4 - c) * (v/p)^2 + c) / 4 where p is the
+// play and c is the curve, which is the cubic curve when c is zero. Deflections
+// below half the play are ignored.
+static void buildAccel(void)
+{
+    uint32_t p = playTable[play];
+    uint32_t w = 4 - curve;
+    uint32_t d = 4 * p * p * p;
+
+    for (uint8_t i = 0; i < ACCEL_SIZE; ++i) {
+        uint32_t v = i + PLAY_XY;
+        uint32_t q;
+
+        if (v < (p >> 1)) {
+            q = 0;
+        } else {
+            q = ((v * (w * v * v + curve * p * p)) << ACCEL_FRAC) / d;
+            if (ACCEL_LIMIT < q)
+                q = ACCEL_LIMIT;
+        }
+        accel[i] = q;
+    }
+}
+
 void initMouse(void)
 {
-    play = ReadNvram(EEPROM_MOUSE);
+    uint8_t val = ReadNvram(EEPROM_MOUSE);
+
+    play = val & ((1u << PAD_CURVE_SHIFT) - 1);
     if (PLAY_MAX <= play)
         play = 0;
-    touchSensor.current = touchSensor.thresh = 0;
+    curve = val >> PAD_CURVE_SHIFT;
+    if (PAD_CURVE_MAX < curve)
+        curve = 0;
+    buildAccel();
+    x = y = wheel = 0;
+    touchSensor.current = touchSensor.baseline = touchSensor.thresh = 0;
+    touchSensor.touched = 0;
 }
 
 void emitMouse(void)
 {
     emitString(about);
     emitKey(KEY_1 + play);
+    emitKey(KEY_MINUS);
+    emitKey(curve ? KEY_1 - 1 + curve : KEY_0);
 
 #if APP_MACHINE_VALUE != 0x4550
     emitKey(KEY_SPACEBAR);
     emitNumber(touchSensor.current);
     emitKey(KEY_SLASH);
     emitNumber(touchSensor.thresh);
+    if (serialOverruns || serialResyncs) {
+        emitKey(KEY_SPACEBAR);
+        emitNumber(serialOverruns);
+        emitKey(KEY_SLASH);
+        emitNumber(serialResyncs);
+    }
 #endif
 
     emitKey(KEY_ENTER);
@@ -104,13 +198,40 @@ static void setPlay(uint8_t val)
         play = 0;
     else
         play = val;
-    WriteNvram(EEPROM_MOUSE, play);
+    WriteNvram(EEPROM_MOUSE, (curve << PAD_CURVE_SHIFT) | play);
+    buildAccel();
+}
+
+static int16_t accumulate(int16_t value, int16_t delta, int16_t limit)
+{
+    value += delta;
+    if (value < -limit)
+        return -limit;
+    if (limit < value)
+        return limit;
+    return value;
+}
+
+// Return the whole part of value in 1/2^frac units, rounded toward zero.
+static int16_t wholeOf(int16_t value, uint8_t frac)
+{
+    return (0 <= value) ? (value >> frac) : -((-value) >> frac);
+}
+
+static int8_t clip(int16_t value)
+{
+    if (127 < value)
+        return 127;
+    if (value < -127)
+        return -127;
+    return value;
 }
 
 void processMouseKeys(uint8_t* current, const uint8_t* processed)
 {
     uint8_t b = 0;
     int8_t w = 0;
+    uint8_t ms;
 
     for (uint8_t i = 2; i < 8; ++i) {
         uint8_t code = current[i];
@@ -159,60 +280,79 @@ void processMouseKeys(uint8_t* current, const uint8_t* processed)
         }
     }
 
-    // Update buttons and wheel atomically
     buttons = b;
-    wheel = w;
+
+    ms = wheelClock;
+    wheelClock = 0;
+    if (w != wheelKey) {
+        wheelKey = w;
+        wheelHeld = 0;
+        wheelRest = 0;
+        if (w)
+            wheel = accumulate(wheel, (0 < w) ? WHEEL_DETENT : -WHEEL_DETENT, WHEEL_LIMIT);
+    } else if (w) {
+        int16_t speed;
+
+        wheelHeld = (ms < 0xffff - wheelHeld) ? wheelHeld + ms : 0xffff;
+        if (WHEEL_DELAY <= wheelHeld) {
+            speed = 1 + (wheelHeld - WHEEL_DELAY) / WHEEL_RAMP;
+            if (WHEEL_SPEED_MAX < speed)
+                speed = WHEEL_SPEED_MAX;
+            wheelRest += speed * ms;
+            speed = wheelRest / WHEEL_PERIOD;
+            wheelRest %= WHEEL_PERIOD;
+            wheel = accumulate(wheel, (0 < w) ? speed : -speed, WHEEL_LIMIT);
+        }
+    }
 }
 
-static int8_t trimXY(uint8_t raw)
+// Return the motion for raw in 1/16 counts.
+static int16_t trimXY(uint8_t raw)
 {
-    int8_t sign;
-    uint16_t value;
-    uint8_t playXY = playTable[play];
+    uint8_t value;
 
-    if (128 <= raw) {
-        sign = 1;
-        value = raw - 128;
-    } else {
-        sign = -1;
-        value = 128 - raw;
-    }
-    if (value < (playXY >> 1) || value < PLAY_XY)
+    value = (128 <= raw) ? raw - 128 : 128 - raw;
+    if (value < PLAY_XY)
         return 0;
-    if (value < playXY) {
-        value = value * value / playXY * value / playXY * 10 / playXY;
-        value = (tick <= value) ? 1 : 0;
-    } else {
-        value = (value * value / (playXY * playXY)) * value / playXY;
-        if (128 <= value)
-            return (0 < sign) ? 127 : -127;
-    }
-    return sign * value;
+    if (ACCEL_SIZE + PLAY_XY <= value)
+        value = ACCEL_SIZE + PLAY_XY - 1;
+    return (128 <= raw) ? (int16_t) accel[value - PLAY_XY] : -(int16_t) accel[value - PLAY_XY];
 }
 
-// Return 0.75 * prev + (1 - 0.75) * raw
-static uint16_t lowPassFilter(uint16_t prev, uint16_t raw)
+static void processTouch(uint16_t raw)
 {
-    prev -= (prev >> 2);
-    raw >>= 2;
-    return prev + raw;
+    uint16_t level;
+    uint16_t base;
+
+    if (!touchSensor.baseline) {
+        touchSensor.current = raw;
+        touchSensor.baseline = raw << 4;
+    } else if (touchSensor.current <= raw) {
+        touchSensor.current += (raw - touchSensor.current) >> TOUCH_FAST;
+    } else {
+        touchSensor.current -= (touchSensor.current - raw) >> TOUCH_FAST;
+    }
+
+    level = touchSensor.current << 4;
+    if (touchSensor.baseline <= level)
+        touchSensor.baseline += (level - touchSensor.baseline) >> TOUCH_FAST;
+    else if (!touchSensor.touched)
+        touchSensor.baseline -= (touchSensor.baseline - level) >> TOUCH_SLOW;
+
+    base = touchSensor.baseline >> 4;
+    touchSensor.thresh = base - (base >> (touchSensor.touched ? TOUCH_RELEASE : TOUCH_PRESS));
+    touchSensor.touched = touchSensor.current < touchSensor.thresh;
+    if (!touchSensor.touched) {
+        wheel = 0;
+        wheelKey = 0;
+    }
 }
 
 static void processSerialData(void)
 {
-    x = trimXY(rawData.x);
-    y = trimXY(rawData.y);
-
-    touchSensor.current = lowPassFilter(touchSensor.current, rawData.touch);
-    if (touchSensor.current < touchSensor.low)
-        touchSensor.low = touchSensor.current;
-    if (touchSensor.low * 7 / 6 < touchSensor.current) {
-        touchSensor.thresh = (touchSensor.low + touchSensor.current) / 2;
-        touchSensor.low = touchSensor.current;
-    }
-
-    if (10 < ++tick)
-        tick = 0;
+    x = accumulate(x, trimXY(rawData.x), motionLimit);
+    y = accumulate(y, trimXY(rawData.y), motionLimit);
+    processTouch(rawData.touch);
 }
 
 // Protocol:
@@ -220,12 +360,15 @@ static void processSerialData(void)
 // 0  t6 t5 t4 t3 t2 t1 t0
 // 0  x6 x5 x4 x3 x2 x1 x0
 // 0  y6 y5 y4 y3 y2 y1 y0
-int8_t processSerialUnit(uint8_t data)
+static int8_t processSerialUnit(uint8_t data)
 {
     int8_t ready = 0;
 
-    if (data & 0x80)
+    if (data & 0x80) {
+        if (rawData.count && serialResyncs < 0xff)
+            ++serialResyncs;
         rawData.count = 1;
+    }
     switch (rawData.count) {
     case 1:
         rawData.touch = ((uint16_t) (data & 0x7c)) << 5;
@@ -255,17 +398,80 @@ int8_t processSerialUnit(uint8_t data)
 
 int8_t isMouseTouched(void)
 {
-    return touchSensor.current < touchSensor.thresh;
+    return touchSensor.touched;
 }
 
 int8_t getKeyboardMouseX(void)
 {
-    return x;
+    return clip(wholeOf(x, ACCEL_FRAC));
 }
 
 int8_t getKeyboardMouseY(void)
 {
-    return y;
+    return clip(wholeOf(y, ACCEL_FRAC));
+}
+
+#ifdef ENABLE_MOUSE_HIRES
+int16_t getKeyboardMouseX16(void)
+{
+    return wholeOf(x, ACCEL_FRAC);
+}
+
+int16_t getKeyboardMouseY16(void)
+{
+    return wholeOf(y, ACCEL_FRAC);
+}
+#endif
+
+// Remove the motion and scroll that have been put in a report. The fractions
+// and whatever did not fit in the report are carried over to the next one.
+void sentKeyboardMouse(int16_t dx, int16_t dy, int8_t dw)
+{
+    x -= dx << ACCEL_FRAC;
+    y -= dy << ACCEL_FRAC;
+    wheel -= wheelFine ? dw : (int16_t) dw << WHEEL_FRAC;
+    reportedButtons = getKeyboardMouseButtons();
+    reportWait = reportInterval;
+}
+
+// Keep up to counts of motion not reported yet, i.e., as much as a single
+// report of the current transport can carry, so that the pointer stops
+// as soon as the finger does.
+void setMouseMotionLimit(int16_t counts)
+{
+    if (motionLimit == counts << ACCEL_FRAC)
+        return;
+    motionLimit = counts << ACCEL_FRAC;
+    x = accumulate(x, 0, motionLimit);
+    y = accumulate(y, 0, motionLimit);
+}
+
+void setMouseReportInterval(uint8_t ms)
+{
+    reportInterval = ms;
+}
+
+// Advance the report clock by ms milliseconds.
+void tickMouseReport(uint8_t ms)
+{
+    reportWait = (ms < reportWait) ? reportWait - ms : 0;
+    wheelClock = (ms < 0xff - wheelClock) ? wheelClock + ms : 0xff;
+}
+
+// Return non-zero if a report should be sent now.
+int8_t isMouseReportDue(void)
+{
+    if (getKeyboardMouseButtons() != reportedButtons)
+        return 1;
+    if (reportWait)
+        return 0;
+    return getKeyboardMouseX() || getKeyboardMouseY() || getKeyboardMouseWheel();
+}
+
+// Report the wheel in 1/8 detents if fine is non-zero, or in detents.
+void setMouseWheelResolution(int8_t fine)
+{
+    wheelFine = fine;
 }
 
 uint8_t getKeyboardMouseButtons(void)
@@ -275,12 +481,45 @@ uint8_t getKeyboardMouseButtons(void)
 
 int8_t getKeyboardMouseWheel(void)
 {
-    return isMouseTouched() ? wheel : 0;
+    if (!isMouseTouched())
+        return 0;
+    return clip(wheelFine ? wheel : wholeOf(wheel, WHEEL_FRAC));
+}
+
+// Called from the UART RX interrupt handler.
+void queueSerialData(uint8_t data)
+{
+    uint8_t next = (serialHead + 1) & (SERIAL_QUEUE_SIZE - 1);
+
+    if (next == serialTail) {
+        serialLost();
+        return;
+    }
+    serialQueue[serialHead] = data;
+    serialHead = next;
+}
+
+// Called from the UART RX interrupt handler when a byte is lost. The frame
+// it belonged to is dropped when the next frame starts.
+void serialLost(void)
+{
+    if (serialOverruns < 0xff)
+        ++serialOverruns;
 }
 
-int8_t isProcessingSrialData(void)
+// Parse the TSAP bytes queued so far, and return non-zero if any frame has
+// been completed.
+int8_t processSerialQueue(void)
 {
-    return 1 <= rawData.count;
+    int8_t ready = 0;
+    uint8_t tail = serialTail;
+
+    while (tail != serialHead) {
+        ready |= processSerialUnit(serialQueue[tail]);
+        tail = (tail + 1) & (SERIAL_QUEUE_SIZE - 1);
+        serialTail = tail;
+    }
+    return ready;
 }
 
 #ifdef WITH_HOS
@@ -25,16 +25,38 @@
 #define PAD_SENSE_4      3
 #define PAD_SENSE_MAX    PAD_SENSE_4
 
+// The upper bits of EEPROM_MOUSE select the acceleration curve; 0 is the
+// cubic curve, and larger values blend in more of a linear one.
+#define PAD_CURVE_SHIFT  4
+#define PAD_CURVE_MAX    3
+
+// Motion that a single report can carry [count]
+#define MOUSE_MOTION_MAX        127
+#ifdef ENABLE_MOUSE_HIRES
+#define MOUSE_HIRES_MOTION_MAX  1023    // Far beyond a flick, while still in 16 bits in 1/16 counts
+#endif
+
 void initMouse(void);
 void emitMouse(void);
-int8_t processSerialUnit(uint8_t data);
+void queueSerialData(uint8_t data);
+void serialLost(void);
+int8_t processSerialQueue(void);
 void processMouseKeys(uint8_t* current, const uint8_t* processed);
 int8_t isMouseTouched(void);
 uint8_t getKeyboardMouseButtons(void);
 int8_t getKeyboardMouseX(void);
 int8_t getKeyboardMouseY(void);
+#ifdef ENABLE_MOUSE_HIRES
+int16_t getKeyboardMouseX16(void);
+int16_t getKeyboardMouseY16(void);
+#endif
+void sentKeyboardMouse(int16_t dx, int16_t dy, int8_t dw);
+void setMouseWheelResolution(int8_t fine);
+void setMouseMotionLimit(int16_t counts);
+void setMouseReportInterval(uint8_t ms);
+void tickMouseReport(uint8_t ms);
+int8_t isMouseReportDue(void);
 int8_t getKeyboardMouseWheel(void);
-int8_t isProcessingSrialData(void);
 
 #ifdef WITH_HOS
 void processMouseData(void);
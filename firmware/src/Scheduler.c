@@ -0,0 +1,64 @@
+/*
+ * Copyright 2026 Esrille Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Scheduler.h"
+
+void initTasks(Task* tasks, uint8_t count)
+{
+    for (Task* task = tasks; task < tasks + count; ++task) {
+        task->due = 0;
+        task->missed = 0;
+    }
+}
+
+// Run the tasks that are due in table order, and return the number of ticks
+// the caller may sleep before a task would run later than its deadline.
+uint8_t runTasks(Task* tasks, uint8_t count, uint8_t elapsed)
+{
+    uint8_t slack = TASK_IDLE;
+
+    for (Task* task = tasks; task < tasks + count; ++task) {
+        if (task->due <= elapsed) {
+            if (task->deadline < elapsed - task->due && task->missed < 0xff)
+                ++task->missed;
+            task->due = task->period;
+            task->run();
+        } else {
+            task->due -= elapsed;
+        }
+        if (task->due + task->deadline < slack)
+            slack = task->due + task->deadline;
+    }
+    return slack;
+}
+
+// Return the runs started later than their deadline since the last call.
+uint8_t missedTasks(Task* tasks, uint8_t count)
+{
+    uint8_t missed = 0;
+
+    for (Task* task = tasks; task < tasks + count; ++task) {
+        missed = (missed < 0xff - task->missed) ? missed + task->missed : 0xff;
+        task->missed = 0;
+    }
+    return missed;
+}
+
+// Make the task due at the next runTasks() call.
+void wakeTask(Task* task)
+{
+    task->due = 0;
+}
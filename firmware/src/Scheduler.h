@@ -0,0 +1,48 @@
+/*
+ * Copyright 2026 Esrille Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+//
+// Tick-driven cooperative scheduler
+//
+// Each task runs to completion every 'period' ticks. The main loop calls
+// runTasks() once per wake-up with the number of ticks elapsed since the
+// previous call, and may sleep for up to the returned number of ticks. A
+// task may thus run up to 'deadline' ticks late to save wake-ups.
+//
+
+typedef struct Task {
+    void (*run)(void);
+    uint8_t period;     // [tick]
+    uint8_t deadline;   // [tick] Lateness allowed before a run counts as missed
+    uint8_t due;        // [tick] Time left until the next run
+    uint8_t missed;     // Runs started later than the deadline
+} Task;
+
+#define TASK(run, period, deadline)     { run, period, deadline, 0, 0 }
+
+#define TASK_IDLE       0xffu           // No task is due
+
+void initTasks(Task* tasks, uint8_t count);
+uint8_t runTasks(Task* tasks, uint8_t count, uint8_t elapsed);
+uint8_t missedTasks(Task* tasks, uint8_t count);
+void wakeTask(Task* task);
+
+#endif  // SCHEDULER_H
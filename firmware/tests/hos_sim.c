@@ -0,0 +1,1196 @@
+/*
+ * Copyright 2026 Esrille Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Simulator of the nRF51 BLE module on the other end of the HOS link (HID
+// over SPI, Hos.h). HosLink.c with the qualified HosMaster.c, HosTasks.c,
+// Scheduler.c and the keyboard core are built as they are for the nisse
+// board, and HosRunTasks() runs on a thread of its own. Every byte that
+// HosXfer() writes to SPI2 is clocked through the simulated module, which
+//
+// - answers each window with the status prepared after the previous one,
+//   of the type requested by it (HOS_TYPE_INFO carries the version, and
+//   HOS_TYPE_TSAP the pad);
+// - sends HOS_DEF_CHARACTER for a window it ignores, as the SPIS does
+//   while the CPU of the module holds the buffers;
+// - advertises, bonds with a new host, and connects after a while, and
+//   hands the keyboard and mouse reports to the host of the current
+//   profile only while connected;
+// - handles HOS_EVENT_SLEEP, HOS_EVENT_KEY_n and
+//   HOS_EVENT_CLEAR_BONDING_DATA;
+// - goes to System OFF once it has told that it is idle, and is woken up by
+//   the next window, which it ignores.
+//
+// Faults are injected at random: a busy module ignores a window, and a
+// noisy line flips a bit of the profile byte so that its checksum fails.
+//
+// The test and the firmware take turns: the test sets the keys held, the
+// pad and the module, and then lets the firmware run until its next
+// Sleep(). Sleep() advances the simulated time by a watchdog period, or in
+// Idle mode until Timer1 overflows. Timer1 runs only while the PIC is
+// awake or idle, and the SPI bytes and __delay_us() take their time.
+//
+// The tests check the retry and checksum handling of HosReport(), the link
+// states, host switching and suspend as HosRunTasks() goes through them,
+// and that the keystrokes typed by the Fn+F1 macro reach the host intact at
+// each fault rate. The SPI line of the second dump, whose windows are told
+// from the call durations, must agree with what the module saw. The
+// transactions, bytes and retries per keystroke are printed for each fault
+// rate, so that changes to the BLE path can be benchmarked without radios. Each test runs in a process of its own, as HosRunTasks()
+// never returns.
+//
+// Built with ENABLE_MOUSE as hos_sim_tsap, the status carries the pad, and
+// the pad is also tested.
+//
+
+#include <Keyboard.h>
+#include <HosMaster.h>
+#include <HosTasks.h>
+#ifdef ENABLE_MOUSE
+#include <Mouse.h>
+#endif
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <system.h>
+#include <spi.h>
+#include "app_device_keyboard.h"
+
+#define CHECK(cond) \
+    do { if (!(cond)) { fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while (0)
+
+// Run the firmware until cond holds, for up to msec of simulated time.
+#define WAIT_FOR(cond, msec) \
+    do { \
+        uint64_t until = now + TIMER1_USEC((msec) * 1000ull); \
+        while (!(cond)) { CHECK(now < until); step(); } \
+    } while (0)
+
+#define TIMER1_USEC(usec)   ((usec) * 3 / 2)    // [Timer1 count at 1.5 MHz]
+#define TICK                TIMER1_USEC(1000000 / WDT_FREQ)
+
+#define RETRY_MAX           5                   // as HosReport()
+
+#define MODULE_VERSION      0x0105
+#define MODULE_VERSION_KEYBOARD_MOUSE   0x0200  // Takes HOS_CMD_KEYBOARD_MOUSE_REPORT
+#define MODULE_REVISION     0x0003
+#define ADVERTISING_TIME    TIMER1_USEC(300000)     // Until a host connects
+#define BONDING_TIME        TIMER1_USEC(200000)     // Pairing with a new host
+
+#define PAD_CENTER          128
+#define PAD_RELEASED        2000                    // Touch level
+#define PAD_TOUCHED         1500
+
+#define HOSTS               4
+#define TEXT_MAX            1024
+
+//
+// Special function registers and library functions
+//
+
+__typeof__(LATDbits) LATDbits;
+__typeof__(TRISDbits) TRISDbits;
+__typeof__(TRISCbits) TRISCbits;
+__typeof__(WDTCONbits) WDTCONbits;
+__typeof__(INTCONbits) INTCONbits;
+__typeof__(PIR1bits) PIR1bits;
+__typeof__(PIE1bits) PIE1bits;
+__typeof__(OSCCONbits) OSCCONbits;
+volatile unsigned char TMR1L, TMR1H;
+volatile unsigned char SSP2BUF;
+unsigned char PMDIS0, PMDIS1, PMDIS2, PMDIS3;
+unsigned char T1CON;
+
+static uint64_t now;            // [Timer1 count] Simulated time
+static uint8_t byteTime;        // [Timer1 count] Time to clock a byte at the SPI2 clock
+
+static sem_t firmwareTurn;
+static sem_t testTurn;
+static bool threaded;           // HosRunTasks() runs on its own thread.
+
+static void moduleEndWindow(void);
+
+static uint16_t readTimer1(void)
+{
+    return TMR1L | (TMR1H << 8);
+}
+
+// Advance the time by count. Timer1 counts it if timer1 is set.
+static void run(uint32_t count, bool timer1)
+{
+    now += count;
+    if (timer1 && (T1CON & 0x01)) {
+        uint32_t t = readTimer1() + count;
+        if (0x10000 <= t)
+            PIR1bits.TMR1IF = 1;
+        TMR1L = (uint8_t) t;
+        TMR1H = (uint8_t) (t >> 8);
+    }
+}
+
+void __delay_us(unsigned long usec)
+{
+    if (LATDbits.LATD5)
+        moduleEndWindow();
+    run(TIMER1_USEC(usec), true);
+}
+
+void _delay(unsigned long cycles)
+{
+    run(cycles / 8, true);     // [Tcy] at 1:8 prescale
+}
+
+// Hand the turn over to the test, and then sleep. The chip select has been
+// raised by now.
+void Sleep(void)
+{
+    moduleEndWindow();
+    if (threaded) {
+        sem_post(&testTurn);
+        sem_wait(&firmwareTurn);
+    }
+    if (OSCCONbits.IDLEN) {
+        // Idle mode, which only Timer1 ends here
+        CHECK(PIE1bits.TMR1IE && !INTCONbits.GIE && (T1CON & 0x01));
+        run(0x10000 - readTimer1(), true);
+    } else {
+        run(TICK, false);   // Until the watchdog timer wakes the PIC up
+    }
+}
+
+void Reset(void)
+{
+    fprintf(stderr, "hos_sim: reset\n");
+    exit(1);
+}
+
+void OpenSPI2(unsigned char sync_mode, unsigned char bus_mode, unsigned char smp_phase)
+{
+    switch (sync_mode) {
+    case SPI_FOSC_4:
+        byteTime = 1;   // 12 MHz
+        break;
+    case SPI_FOSC_16:
+        byteTime = 4;   // 3 MHz
+        break;
+    default:
+        byteTime = 16;  // 750 kHz
+        break;
+    }
+}
+
+void CloseSPI2(void)
+{
+    byteTime = 0;
+}
+
+//
+// Module
+//
+
+typedef struct Counters {
+    unsigned windows;           // Chip select windows
+    unsigned bytes;             // Bytes clocked in
+    unsigned ignored;           // Windows answered with HOS_DEF_CHARACTER
+    unsigned corrupted;         // Windows with a broken profile byte
+    unsigned calls;             // HosReport() calls, told apart by the retries
+    unsigned reportCalls;       // and those of a report command
+    unsigned failures;          // and those that returned 0
+    unsigned reports;           // Keyboard reports handed to the host
+    unsigned mouseReports;      // Mouse reports handed to the host
+    unsigned combinedReports;   // HOS_CMD_KEYBOARD_MOUSE_REPORT taken
+    unsigned dropped;           // Reports received while not connected
+} Counters;
+
+static struct Module {
+    uint16_t version;
+    uint8_t profile;
+    uint8_t state;              // HOS_BLE_STATE_*
+    uint64_t stateSince;        // [Timer1 count]
+    uint8_t bonded;             // A bit for each profile bonded with a host
+    uint8_t battery;
+    uint8_t padX;
+    uint8_t padY;
+    uint16_t padTouch;
+    uint8_t tx[HOS_STATE_LAST + 1];     // Status for the next window
+    uint8_t rx[3 + 255];
+    unsigned pos;               // Bytes clocked in this window
+    uint8_t profileSent;        // Profile byte sent in this window
+    uint8_t indicateSent;       // HOS_STATE_INDICATE sent in this window
+    bool selected;
+    bool off;                   // In System OFF
+    bool busy;                  // Ignoring this window
+    bool noisy;                 // Breaking the profile byte of this window
+    unsigned ignoredInRow;      // Windows ignored since the last call ended
+    unsigned busyWindows;       // Windows to ignore from the next one
+    unsigned corruptWindows;    // Windows to break from the next one
+    unsigned busyRate;          // [1/1000] Windows ignored at random
+    unsigned noiseRate;         // [1/1000] Windows broken at random
+    Counters count;
+} module;
+
+// The reports as seen by each host
+typedef struct Host {
+    uint8_t report[8];
+    char text[TEXT_MAX];
+    unsigned length;
+    uint8_t buttons;
+    int dx;                     // Motion and scroll summed over the mouse reports
+    int dy;
+    int wheel;
+} Host;
+
+static Host hosts[HOSTS];
+
+static uint32_t seed = 1;
+
+static uint32_t xorshift(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static char toChar(uint8_t key)
+{
+    if (KEY_A <= key && key <= KEY_Z)
+        return 'A' + key - KEY_A;
+    if (KEY_1 <= key && key <= KEY_9)
+        return '1' + key - KEY_1;
+    switch (key) {
+    case KEY_0:
+        return '0';
+    case KEY_ENTER:
+        return '\n';
+    case KEY_SPACEBAR:
+        return ' ';
+    case KEY_MINUS:
+        return '-';
+    case KEY_COMMA:
+        return ',';
+    case KEY_PERIOD:
+        return '.';
+    case KEY_SLASH:
+        return '/';
+    default:
+        return '?';
+    }
+}
+
+// Append each key pressed since the last report to text.
+static unsigned appendKeys(const uint8_t* report, const uint8_t* last, char* text, unsigned length)
+{
+    for (int i = 2; i < 8; ++i) {
+        if (report[i] && !memchr(last + 2, report[i], 6) && length < TEXT_MAX - 1)
+            text[length++] = toChar(report[i]);
+    }
+    text[length] = '\0';
+    return length;
+}
+
+static bool checkProfile(uint8_t profile)
+{
+    return ((~profile >> 4) & 0x0f) == (profile & 0x0f);
+}
+
+static bool isReport(uint8_t cmd)
+{
+    return cmd == HOS_CMD_KEYBOARD_REPORT || cmd == HOS_CMD_MOUSE_REPORT || cmd == HOS_CMD_KEYBOARD_MOUSE_REPORT;
+}
+
+static void hostReceive(const uint8_t* report)
+{
+    Host* host = &hosts[module.profile];
+
+    host->length = appendKeys(report, host->report, host->text, host->length);
+    memcpy(host->report, report, 8);
+    ++module.count.reports;
+}
+
+static void hostReceiveMouse(const uint8_t* report)
+{
+    Host* host = &hosts[module.profile];
+
+    host->buttons = report[0];
+    host->dx += (int8_t) report[1];
+    host->dy += (int8_t) report[2];
+    host->wheel += (int8_t) report[3];
+    ++module.count.mouseReports;
+}
+
+static void moduleSetState(uint8_t state)
+{
+    module.state = state;
+    module.stateSince = now;
+}
+
+static void moduleUpdateState(void)
+{
+    uint64_t elapsed = now - module.stateSince;
+
+    switch (module.state) {
+    case HOS_BLE_STATE_ADVERTISING:
+        if (ADVERTISING_TIME <= elapsed)
+            moduleSetState((module.bonded & (1u << module.profile)) ? HOS_BLE_STATE_CONNECTED : HOS_BLE_STATE_BONDING);
+        break;
+    case HOS_BLE_STATE_BONDING:
+        if (BONDING_TIME <= elapsed) {
+            module.bonded |= 1u << module.profile;
+            moduleSetState(HOS_BLE_STATE_CONNECTED);
+            memset(hosts[module.profile].report, 0, 8);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void moduleBoot(uint8_t profile, uint16_t version)
+{
+    memset(&module, 0, sizeof module);
+    module.version = version;
+    module.profile = profile;
+    module.battery = 100;
+    module.padX = module.padY = PAD_CENTER;
+    module.padTouch = PAD_RELEASED;
+    moduleSetState(HOS_BLE_STATE_ADVERTISING);
+    // No status has been prepared yet, and the zero profile byte fails the
+    // checksum.
+}
+
+static void modulePrepare(uint8_t type)
+{
+    memset(module.tx, 0, sizeof module.tx);
+    module.tx[HOS_STATE_PROFILE] = (uint8_t) (((~module.profile & 0x0f) << 4) | module.profile);
+    module.tx[HOS_STATE_LED] = 0;
+    module.tx[HOS_STATE_BATT] = module.battery;
+    module.tx[HOS_STATE_INDICATE] = module.state;
+    module.tx[HOS_STATE_TYPE] = type;
+    switch (type) {
+    case HOS_TYPE_INFO:
+        module.tx[HOS_STATE_REV_MAJOR] = MODULE_REVISION >> 8;
+        module.tx[HOS_STATE_REV_MINOR] = (uint8_t) MODULE_REVISION;
+        module.tx[HOS_STATE_VER_MAJOR] = module.version >> 8;
+        module.tx[HOS_STATE_VER_MINOR] = (uint8_t) module.version;
+        break;
+    case HOS_TYPE_TSAP:
+        module.tx[HOS_STATE_X] = module.padX;
+        module.tx[HOS_STATE_Y] = module.padY;
+        module.tx[HOS_STATE_TOUCH_LO] = (uint8_t) module.padTouch;
+        module.tx[HOS_STATE_TOUCH_HI] = module.padTouch >> 8;
+        break;
+    default:
+        break;
+    }
+}
+
+static void moduleEvent(uint8_t event)
+{
+    switch (event) {
+    case HOS_EVENT_SLEEP:
+        moduleSetState(HOS_BLE_STATE_IDLE);
+        break;
+    case HOS_EVENT_WAKEUP:
+    case HOS_EVENT_DISCONNECT:
+    case HOS_EVENT_ADVERTISING_START:
+        moduleSetState(HOS_BLE_STATE_ADVERTISING);
+        break;
+    case HOS_EVENT_CLEAR_BONDING_DATA:
+        module.bonded &= ~(1u << module.profile);
+        moduleSetState(HOS_BLE_STATE_ADVERTISING);
+        break;
+    default:
+        if (HOS_EVENT_KEY_0 <= event && event <= HOS_EVENT_KEY_LAST) {
+            module.profile = event - HOS_EVENT_KEY_0;
+            moduleSetState(HOS_BLE_STATE_ADVERTISING);
+        }
+        break;
+    }
+}
+
+static void moduleBeginWindow(void)
+{
+    module.selected = true;
+    module.pos = 0;
+    moduleUpdateState();
+    if (module.off) {
+        // The chip select wakes the module up from System OFF, and the
+        // window is lost while it restarts.
+        module.off = false;
+        moduleSetState(HOS_BLE_STATE_ADVERTISING);
+        module.busy = true;
+    } else if (module.busyWindows) {
+        --module.busyWindows;
+        module.busy = true;
+    } else {
+        module.busy = xorshift() % 1000 < module.busyRate;
+    }
+    if (module.corruptWindows) {
+        --module.corruptWindows;
+        module.noisy = true;
+    } else {
+        module.noisy = xorshift() % 1000 < module.noiseRate;
+    }
+    ++module.count.windows;
+    if (module.busy)
+        ++module.count.ignored;
+    else if (module.noisy)
+        ++module.count.corrupted;
+}
+
+// HosReport() ends a call at the first window answered, or after RETRY_MAX
+// windows ignored in a row.
+static void moduleCountCall(void)
+{
+    bool failed;
+
+    if (module.busy) {
+        if (++module.ignoredInRow < RETRY_MAX)
+            return;
+        failed = true;
+    } else {
+        failed = !checkProfile(module.profileSent);
+    }
+    module.ignoredInRow = 0;
+    ++module.count.calls;
+    if (isReport(module.rx[1]))
+        ++module.count.reportCalls;
+    if (failed)
+        ++module.count.failures;
+}
+
+// Act on the command received once the chip select is raised.
+static void moduleEndWindow(void)
+{
+    const uint8_t* data = module.rx + 3;
+    uint8_t len = module.rx[2];
+    bool connected = module.state == HOS_BLE_STATE_CONNECTED;
+
+    if (!module.selected)
+        return;
+    module.selected = false;
+    moduleCountCall();
+    if (module.busy)
+        return;
+    CHECK(3 <= module.pos && 3u + len <= module.pos);
+    switch (module.rx[1]) {
+    case HOS_CMD_SET_EVENT:
+        CHECK(len == 1);
+        moduleEvent(data[0]);
+        break;
+    case HOS_CMD_BATT_REPORT:
+        CHECK(len == 1);
+        module.battery = data[0];
+        break;
+    case HOS_CMD_KEYBOARD_REPORT:
+        CHECK(len == 8);
+        if (connected)
+            hostReceive(data);
+        else
+            ++module.count.dropped;
+        break;
+    case HOS_CMD_MOUSE_REPORT:
+        CHECK(len == 4);
+        if (connected)
+            hostReceiveMouse(data);
+        else
+            ++module.count.dropped;
+        break;
+    case HOS_CMD_KEYBOARD_MOUSE_REPORT:
+        CHECK(len == 12);
+        if (module.version < MODULE_VERSION_KEYBOARD_MOUSE) {
+            ++module.count.dropped;     // Unknown to the module
+        } else if (connected) {
+            hostReceive(data);
+            hostReceiveMouse(data + 8);
+            ++module.count.combinedReports;
+        } else {
+            ++module.count.dropped;
+        }
+        break;
+    case HOS_CMD_GET_STATUS:
+    default:
+        break;
+    }
+    if (module.state == HOS_BLE_STATE_IDLE && module.indicateSent == HOS_BLE_STATE_IDLE)
+        module.off = true;
+    modulePrepare(module.rx[0]);
+}
+
+signed char WriteSPI2(unsigned char data_out)
+{
+    CHECK(!LATDbits.LATD5 && byteTime);
+    if (!module.selected)
+        moduleBeginWindow();
+    if (module.pos < sizeof module.rx)
+        module.rx[module.pos] = data_out;
+    if (module.busy)
+        SSP2BUF = HOS_DEF_CHARACTER;
+    else if (module.pos <= HOS_STATE_LAST)
+        SSP2BUF = module.tx[module.pos] ^ ((module.noisy && module.pos == HOS_STATE_PROFILE) ? 0x01 : 0);
+    else
+        SSP2BUF = 0;
+    if (module.pos == HOS_STATE_PROFILE)
+        module.profileSent = SSP2BUF;
+    else if (module.pos == HOS_STATE_INDICATE)
+        module.indicateSent = SSP2BUF;
+    ++module.pos;
+    ++module.count.bytes;
+    run(byteTime, true);
+    return 0;
+}
+
+//
+// Board and application functions used by HosTasks.c and the keyboard core
+//
+
+static uint8_t profiles[PROFILE_MAX][PROFILE_SIZE];
+static uint8_t global[GLOBAL_SIZE];
+static uint8_t currentProfile;
+
+uint8_t ReadNvram(uint8_t offset)
+{
+    return profiles[currentProfile][offset];
+}
+
+void WriteNvram(uint8_t offset, uint8_t value)
+{
+    profiles[currentProfile][offset] = value;
+}
+
+void PollNvram(void)
+{
+}
+
+void FlushNvram(void)
+{
+}
+
+void SelectProfile(uint8_t profile)
+{
+    currentProfile = profile;
+}
+
+uint8_t CurrentProfile(void)
+{
+    return currentProfile;
+}
+
+uint8_t ReadGlobalNvram(uint8_t offset)
+{
+    return global[offset];
+}
+
+void WriteGlobalNvram(uint8_t offset, uint8_t value)
+{
+    global[offset] = value;
+}
+
+bool isUSBMode(void)
+{
+    return false;
+}
+
+bool isBusPowered(void)
+{
+    return false;
+}
+
+static uint8_t leds;            // LED_D1 to LED_D3 lit
+static uint8_t ledReport;       // The last APP_LEDUpdate()
+static bool suspended;
+static unsigned wakes;
+static uint64_t wokeAt;         // Time of the first wake-up since wakes was cleared
+static uint8_t wakeReport[8];   // The first report made since wakeReported was cleared
+static uint64_t wakeReportAt;
+static bool wakeReported;
+
+void LED_On(LED led)
+{
+    leds |= 1u << led;
+}
+
+void LED_Off(LED led)
+{
+    leds &= ~(1u << led);
+}
+
+void APP_LEDUpdate(uint8_t report)
+{
+    ledReport = report;
+}
+
+void APP_Suspend(void)
+{
+    suspended = true;
+}
+
+void APP_WakeFromSuspend(void)
+{
+    suspended = false;
+    if (!wakes++)
+        wokeAt = now;
+}
+
+//
+// Keyboard
+//
+
+static bool matrix[8][12];      // Keys held
+static uint8_t report[8];
+static int8_t xmit;
+static char sentText[TEXT_MAX]; // The keys in the reports made by the scan
+static unsigned sentLength;
+static uint8_t sentReport[8];
+static unsigned keystrokes;
+static unsigned scans;
+static uint64_t scanAt;         // Time of the last scan
+static uint64_t gapMin;         // Shortest and longest scan intervals while
+static uint64_t gapMax;         // a key is held
+
+// Counts at the scan that dumped the statistics
+static Counters dumped;
+static unsigned dumpedKeystrokes;
+
+bool BUTTON_IsPressed()
+{
+    for (int row = 0; row < 8; ++row) {
+        for (int column = 0; column < 12; ++column) {
+            if (matrix[row][column])
+                return true;
+        }
+    }
+    return false;
+}
+
+// Follows APP_KeyboardScan() of app_device_keyboard.c.
+uint8_t* APP_KeyboardScan(void)
+{
+    if (LATDbits.LATD5)
+        moduleEndWindow();
+    ++scans;
+    if (BUTTON_IsPressed() && scanAt) {
+        if (now - scanAt < gapMin)
+            gapMin = now - scanAt;
+        if (gapMax < now - scanAt)
+            gapMax = now - scanAt;
+    }
+    scanAt = now;
+    if (xmit == XMIT_IN_ORDER) {
+        uint8_t key = peekMacro();
+        uint8_t mod = 0;
+        if (key == KEYPAD_PERCENT) {
+            key = KEY_5;
+            mod = MOD_LEFTSHIFT;
+        }
+        if (report[2] && report[2] == key)
+            report[2] = 0;      // BRK
+        else {
+            getMacro();
+            report[2] = key;
+            report[0] = mod;
+            if (!report[2])
+                xmit = XMIT_NONE;
+        }
+    } else {
+        for (int row = 7; 0 <= row; --row) {
+            for (int column = 0; column < 12; ++column) {
+                if (matrix[row][column])
+                    onPressed(row, column);
+            }
+        }
+        xmit = makeReport(report);
+        switch (xmit) {
+        case XMIT_BRK:
+            memset(report + 2, 0, 6);
+            break;
+        case XMIT_IN_ORDER:
+            for (uint8_t i = 0; i < 6; ++i)
+                emitKey(report[2 + i]);
+            report[2] = beginMacro(6);
+            memset(report + 3, 0, 5);
+            break;
+        case XMIT_MACRO:
+            dumped = module.count;
+            dumpedKeystrokes = keystrokes;
+            xmit = XMIT_IN_ORDER;
+            report[0] = 0;
+            report[2] = beginMacro(MAX_MACRO_SIZE);
+            memset(report + 3, 0, 5);
+            break;
+        default:
+            break;
+        }
+    }
+    if (!xmit)
+        return NULL;
+    if (!wakeReported) {
+        memcpy(wakeReport, report, 8);
+        wakeReportAt = now;
+        wakeReported = true;
+    }
+    unsigned before = sentLength;
+    sentLength = appendKeys(report, sentReport, sentText, sentLength);
+    keystrokes += sentLength - before;
+    memcpy(sentReport, report, 8);
+    return report;
+}
+
+//
+// Test driver
+//
+
+typedef struct Key {
+    uint8_t row;
+    uint8_t column;
+} Key;
+
+static const Key keyFn = { 4, 0 };
+static const Key keyShift = { 5, 0 };
+static const Key keyF1 = { 0, 0 };
+static const Key keyF2 = { 0, 1 };
+static const Key keyF4 = { 0, 3 };
+static const Key keyA = { 6, 1 };
+static const Key keyB = { 7, 5 };
+#ifdef ENABLE_MOUSE
+static const Key keyI = { 5, 8 };     // Scrolls up with the pad touched
+#endif
+
+static void *firmware(void* arg)
+{
+    sem_wait(&firmwareTurn);
+    HosRunTasks(false);
+    return NULL;    // NOT REACHED HERE
+}
+
+// Let the firmware run until its next Sleep().
+static void step(void)
+{
+    sem_post(&firmwareTurn);
+    sem_wait(&testTurn);
+}
+
+static void runFor(unsigned msec)
+{
+    uint64_t until = now + TIMER1_USEC(msec * 1000ull);
+
+    while (now < until)
+        step();
+}
+
+static void hold(const Key* keys, int count, bool down)
+{
+    for (int i = 0; i < count; ++i)
+        matrix[keys[i].row][keys[i].column] = down;
+}
+
+// Press the keys together for 100 msec, and release them for 100 msec.
+static void type(const Key* keys, int count)
+{
+    hold(keys, count, true);
+    runFor(100);
+    hold(keys, count, false);
+    runFor(100);
+}
+
+// Type key while holding the modifiers, e.g., Fn.
+static void chord(const Key* modifiers, int count, Key key)
+{
+    hold(modifiers, count, true);
+    runFor(50);
+    type(&key, 1);
+    hold(modifiers, count, false);
+    runFor(100);
+}
+
+static bool isConnected(void)
+{
+    return module.state == HOS_BLE_STATE_CONNECTED && HosGetIndication() == HOS_BLE_STATE_CONNECTED;
+}
+
+static void resetKeyboard(void)
+{
+    memset(profiles, 0, sizeof profiles);
+    for (int p = 0; p < PROFILE_MAX; ++p)
+        memcpy(profiles[p], nvram_initial_data, NVRAM_INITIAL_DATA_SIZE);
+    initKeyboard();
+#ifdef ENABLE_MOUSE
+    initMouse();
+#endif
+    memset(report, 0, sizeof report);
+    xmit = XMIT_NONE;
+}
+
+// Power on the keyboard and a module of version, and run HosRunTasks()
+// until the module is connected to the host of profile 0.
+static void powerOn(uint16_t version)
+{
+    pthread_t thread;
+
+    moduleBoot(0, version);
+    resetKeyboard();
+    HosInitialize();
+    CHECK(!sem_init(&firmwareTurn, 0, 0) && !sem_init(&testTurn, 0, 0));
+    threaded = true;
+    CHECK(!pthread_create(&thread, NULL, firmware, NULL));
+    WAIT_FOR(isConnected(), 2000);
+    CHECK(HosGetVersion() == version && HosGetRevision() == MODULE_REVISION);
+}
+
+// Run test in a child process, as the firmware does not return.
+static void runTest(const char* name, void (*test)(void))
+{
+    int status;
+    pid_t pid;
+
+    fflush(stdout);
+    pid = fork();
+    CHECK(0 <= pid);
+    if (pid == 0) {
+        test();
+        fflush(stdout);
+        exit(0);
+    }
+    CHECK(waitpid(pid, &status, 0) == pid);
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+        fprintf(stderr, "hos_sim: %s failed\n", name);
+        exit(1);
+    }
+}
+
+//
+// Tests
+//
+
+// Return the counts including the last window, which ends once the chip
+// select is raised.
+static Counters counts(void)
+{
+    moduleEndWindow();
+    return module.count;
+}
+
+// Call HosReport() directly while the module is connected.
+static void testRetries(void)
+{
+    uint8_t keys[8] = { 0 };
+    Counters before;
+
+    moduleBoot(0, MODULE_VERSION);
+    module.bonded = 1;
+    moduleSetState(HOS_BLE_STATE_CONNECTED);
+    HosInitialize();
+    CHECK(!HosGetStatus(HOS_TYPE_DEFAULT));     // No status prepared yet
+    CHECK(HosGetStatus(HOS_TYPE_DEFAULT));
+    CHECK(HosGetIndication() == HOS_BLE_STATE_CONNECTED);
+
+    // Windows ignored up to the retry limit
+    before = counts();
+    module.busyWindows = RETRY_MAX - 1;
+    CHECK(HosGetStatus(HOS_TYPE_DEFAULT));
+    CHECK(counts().windows - before.windows == RETRY_MAX);
+    CHECK(counts().ignored - before.ignored == RETRY_MAX - 1);
+    CHECK(counts().bytes - before.bytes == RETRY_MAX * (HOS_STATE_LAST + 1));
+    CHECK(counts().calls - before.calls == 1 && counts().failures == before.failures);
+
+    // and past it
+    before = counts();
+    module.busyWindows = RETRY_MAX;
+    CHECK(!HosGetStatus(HOS_TYPE_DEFAULT));
+    CHECK(counts().windows - before.windows == RETRY_MAX);
+    CHECK(counts().calls - before.calls == 1 && counts().failures - before.failures == 1);
+
+    // A broken profile byte fails the call without a retry, and the status
+    // is not taken.
+    CHECK(HosSetEvent(HOS_TYPE_DEFAULT, HOS_EVENT_KEY_3));
+    before = counts();
+    module.corruptWindows = 1;
+    CHECK(!HosGetStatus(HOS_TYPE_DEFAULT));
+    CHECK(counts().windows - before.windows == 1 && counts().failures - before.failures == 1);
+    CHECK(HosGetProfile() == 0 && HosGetIndication() == HOS_BLE_STATE_CONNECTED);
+    CHECK(HosGetStatus(HOS_TYPE_DEFAULT));
+    CHECK(HosGetProfile() == 3);
+
+    // A keyboard report is 3 bytes of header and 8 bytes of data.
+    before = counts();
+    CHECK(HosReport(HOS_TYPE_DEFAULT, HOS_CMD_KEYBOARD_REPORT, 8, keys));
+    CHECK(counts().bytes - before.bytes == 3 + 8 && counts().reportCalls - before.reportCalls == 1);
+}
+
+// Bond with the hosts, type to them, and switch between them.
+static void testLink(void)
+{
+    const Key fnShift[] = { keyFn, keyShift };
+
+    powerOn(MODULE_VERSION);
+    CHECK(module.count.dropped == 0);
+    type(&keyA, 1);
+    WAIT_FOR(hosts[0].length == 1, 1000);
+    CHECK(!strcmp(hosts[0].text, "A"));
+
+    // The key typed right after the switch reaches the new host once it has
+    // been paired.
+    chord(fnShift, 2, keyF2);
+    CHECK(CurrentProfile() == 2);
+    type(&keyB, 1);
+    WAIT_FOR(hosts[2].length == 1, 2000);
+    CHECK(module.profile == 2 && !strcmp(hosts[2].text, "B"));
+
+    // A host already bonded connects without pairing.
+    chord(fnShift, 2, keyF4);
+    type(&keyA, 1);
+    WAIT_FOR(hosts[0].length == 2, 2000);
+    CHECK(module.profile == 0 && !strcmp(hosts[0].text, "AA"));
+    CHECK(!strcmp(hosts[2].text, "B"));
+
+    // Forget the host, which is then paired again.
+    uint64_t start = now;
+    moduleEvent(HOS_EVENT_CLEAR_BONDING_DATA);
+    WAIT_FOR(module.state == HOS_BLE_STATE_BONDING, 1000);
+    WAIT_FOR(isConnected(), 1000);
+    CHECK(ADVERTISING_TIME + BONDING_TIME <= now - start);
+}
+
+// Suspend while the module sleeps, and resume with a key.
+static void testSuspend(void)
+{
+    unsigned windows;
+
+    powerOn(MODULE_VERSION);
+    moduleSetState(HOS_BLE_STATE_IDLE);     // The host has gone away.
+    WAIT_FOR(suspended, 2000);
+    windows = module.count.windows;
+    runFor(1000);
+    CHECK(suspended && module.count.windows == windows);
+
+    // The module wakes up on the next window, and connects again. The key
+    // that woke the keyboard up is in the first report, which is made after
+    // the debounce at the scan interval as usual without suspending again.
+    wakes = 0;
+    wakeReported = false;
+    type(&keyA, 1);
+    CHECK(!suspended && wakes == 1);
+    CHECK(wakeReported && memchr(wakeReport + 2, KEY_A, 6));
+    CHECK(wakeReportAt - wokeAt <= TIMER1_USEC((DELAY_12 + 1) * APP_KEYBOARD_SCAN_MSEC * 1000 + 1000));
+    WAIT_FOR(hosts[0].length == 1, 2000);
+    CHECK(!strcmp(hosts[0].text, "A"));
+}
+
+// Scan at the interval of the USB loop while a key is held, so that the
+// delays and the debounce counted in scans keep their length.
+static void testScanInterval(void)
+{
+    powerOn(MODULE_VERSION);
+    runFor(1000);
+    hold(&keyA, 1, true);
+    runFor(100);
+    gapMin = UINT64_MAX;
+    gapMax = 0;
+    runFor(500);
+    hold(&keyA, 1, false);
+    CHECK(TIMER1_USEC((APP_KEYBOARD_SCAN_MSEC - 1) * 1000) <= gapMin);
+    CHECK(gapMax <= TIMER1_USEC((APP_KEYBOARD_SCAN_MSEC + 1) * 1000));
+}
+
+#ifdef ENABLE_MOUSE
+// Move the pointer with the pad.
+static void testPad(void)
+{
+    unsigned reports;
+
+    powerOn(MODULE_VERSION);
+    runFor(500);
+    CHECK(module.count.mouseReports == 0);
+
+    module.padTouch = PAD_TOUCHED;
+    module.padX = PAD_CENTER + 64;
+    runFor(300);
+    CHECK(module.count.mouseReports && 0 < hosts[0].dx && hosts[0].dy == 0);
+
+    module.padTouch = PAD_RELEASED;
+    module.padX = PAD_CENTER;
+    runFor(200);
+    reports = module.count.mouseReports;
+    runFor(500);
+    CHECK(module.count.mouseReports == reports);
+
+    // While the keyboard is in use, a touch is seen within a couple of ticks.
+    type(&keyA, 1);
+    runFor(1000);
+    module.padTouch = PAD_TOUCHED;
+    module.padX = PAD_CENTER + 64;
+    WAIT_FOR(module.count.mouseReports != reports, 3 * 1000 / WDT_FREQ);
+    module.padTouch = PAD_RELEASED;
+    module.padX = PAD_CENTER;
+    runFor(200);
+
+    // Nobody is at the keyboard after HOS_IDLE_DELAY, and the status is
+    // polled less often.
+    runFor(6000);
+    reports = module.count.mouseReports;
+    module.padTouch = PAD_TOUCHED;
+    module.padX = PAD_CENTER + 64;
+    WAIT_FOR(module.count.mouseReports != reports, 300);
+}
+
+// Press a key while moving the pointer. A module that takes
+// HOS_CMD_KEYBOARD_MOUSE_REPORT gets the keyboard and the mouse reports due
+// at the same tick in one transaction, and an older one gets them
+// separately. Neither drops a report.
+static void pressWithPad(uint16_t version)
+{
+    powerOn(version);
+    runFor(500);
+    module.padTouch = PAD_TOUCHED;
+    module.padX = PAD_CENTER + 64;
+    runFor(100);
+    type(&keyA, 1);
+    module.padTouch = PAD_RELEASED;
+    module.padX = PAD_CENTER;
+    runFor(200);
+    CHECK(0 < hosts[0].dx && module.count.dropped == 0);
+}
+
+static void testCombinedReport(void)
+{
+    pressWithPad(MODULE_VERSION_KEYBOARD_MOUSE);
+    CHECK(module.count.combinedReports);
+}
+
+static void testSeparateReports(void)
+{
+    pressWithPad(MODULE_VERSION);
+    CHECK(module.count.combinedReports == 0);
+}
+
+// Scroll with a wheel key while touching the pad. One detent is scrolled at
+// once, and the speed goes up with the time the key is held, which is
+// about 34 detents for a second.
+static void testWheel(void)
+{
+    powerOn(MODULE_VERSION);
+    runFor(500);
+    module.padTouch = PAD_TOUCHED;
+    runFor(200);
+    hold(&keyI, 1, true);
+    runFor(1000);
+    hold(&keyI, 1, false);
+    runFor(200);
+    module.padTouch = PAD_RELEASED;
+    runFor(200);
+    CHECK(32 <= hosts[0].wheel && hosts[0].wheel <= 36);
+}
+#endif
+
+// Fn+F1 types the about text including the statistics. Wait until the last
+// key of it has reached the host.
+static void pressAbout(void)
+{
+    chord(&keyFn, 1, keyF1);
+    WAIT_FOR(xmit == XMIT_NONE && hosts[0].length == sentLength, 60000);
+    runFor(500);
+}
+
+// Type the about text twice over a link with faults, and check that the
+// host got every keystroke, and that the SPI line of the second dump tells
+// what the module saw while the first one was sent.
+static void benchmark(unsigned busyRate, unsigned noiseRate)
+{
+    Counters first, second;
+    unsigned firstKeystrokes;
+    unsigned transactions, reports, bytes, retries, failures, average, longest;
+    const char* line = NULL;
+
+    powerOn(MODULE_VERSION);
+    module.busyRate = busyRate;
+    module.noiseRate = noiseRate;
+    hosts[0].length = sentLength = 0;
+
+    pressAbout();
+    first = dumped;
+    firstKeystrokes = dumpedKeystrokes;
+    pressAbout();
+    second = dumped;
+    CHECK(first.windows < second.windows);
+
+    CHECK(sentLength && hosts[0].length == sentLength && !strcmp(hosts[0].text, sentText));
+    for (const char* p = hosts[0].text; (p = strstr(p, "\nSPI ")); ++p)
+        line = p;       // The one of the second dump
+    CHECK(line);
+    CHECK(sscanf(line, "\nSPI %u/%u %u %u %u %u/%u", &transactions, &reports, &bytes, &retries, &failures, &average, &longest) == 7);
+    CHECK(transactions == second.windows - first.windows);
+    CHECK(bytes == second.bytes - first.bytes);
+    CHECK(retries == second.ignored - first.ignored);
+    CHECK(reports == second.reportCalls - first.reportCalls);
+    CHECK(failures == second.failures - first.failures);
+    CHECK(second.corrupted - first.corrupted <= failures);
+    CHECK(0 < average && average <= longest);
+
+    unsigned keys = dumpedKeystrokes - firstKeystrokes;
+    printf("%5.1f%% %5.1f%% %9.2f %9.2f %11.2f %8u %7u\n",
+           busyRate / 10.0, noiseRate / 10.0,
+           (double) transactions / keys, (double) bytes / keys, (double) retries / keys,
+           failures, average);
+}
+
+static void benchmarkClean(void)
+{
+    benchmark(0, 0);
+}
+
+static void benchmarkBusy(void)
+{
+    benchmark(10, 0);
+}
+
+static void benchmarkNoisy(void)
+{
+    benchmark(100, 10);
+}
+
+static void benchmarkWorst(void)
+{
+    benchmark(300, 50);
+}
+
+int main(void)
+{
+    runTest("testRetries", testRetries);
+    runTest("testLink", testLink);
+    runTest("testSuspend", testSuspend);
+    runTest("testScanInterval", testScanInterval);
+#ifdef ENABLE_MOUSE
+    runTest("testPad", testPad);
+    runTest("testWheel", testWheel);
+    runTest("testCombinedReport", testCombinedReport);
+    runTest("testSeparateReports", testSeparateReports);
+#endif
+
+    printf("  busy  noisy  xfers/key bytes/key retries/key failures avg[us]\n");
+    runTest("benchmark", benchmarkClean);
+    runTest("benchmark", benchmarkBusy);
+    runTest("benchmark", benchmarkNoisy);
+    runTest("benchmark", benchmarkWorst);
+    printf("hos_sim: passed\n");
+    return 0;
+}
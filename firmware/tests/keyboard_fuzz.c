@@ -0,0 +1,369 @@
+/*
+ * Copyright 2026 Esrille Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Fuzz harness for makeReport() and the macro buffer. Each input is a
+// sequence of key matrix frames and settings changes that is run through
+// the same steps as APP_KeyboardScan() in app_device_keyboard.c, and the
+// following is checked after each scan:
+//
+// - makeReport() returns one of the XMIT_* values, and the 8-byte report
+//   is not written past its end (caught by AddressSanitizer);
+// - a macro ends within 2 * MAX_MACRO_SIZE scans (a key and its break
+//   for each byte of ordered_keys);
+// - once all the keys are released, the report settles with no key and
+//   no modifier other than the latched prefix shift.
+//
+// With gcc, "make check" runs the inputs generated from a fixed seed, and
+// writes the first input that fails to keyboard_fuzz.crash. Then
+//
+//     ./keyboard_fuzz -m keyboard_fuzz.crash
+//
+// shrinks it to keyboard_fuzz.min, and "./keyboard_fuzz FILE..." replays
+// inputs. With clang, "make fuzz" builds a coverage-guided libFuzzer
+// binary instead, which also takes -minimize_crash=1.
+//
+// Input format, one operation after another:
+//
+//   0x00-0xdf  frame: the low 3 bits give the number of keys pressed
+//              (0 to 7), followed by that many bytes of key code (modulo
+//              96); the frame is scanned ((byte >> 3) & 3) + 1 times.
+//   0xe0-0xe8  setting: the next byte is written at EEPROM_BASE + (byte
+//              & 0x0f), and initKeyboard() is called.
+//   0xf0       host LED report: the next byte is passed to controlLED().
+//   0xf1       USB mode and bus power are toggled.
+//   other      all the keys are released, and the report must settle.
+//
+
+#include <Keyboard.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <system.h>
+
+#ifndef FUZZER
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define SETTLE_SCANS    (DELAY_MAX + 3)                 // Scans with no change that count as settled
+#define MACRO_SCANS     (2 * MAX_MACRO_SIZE + 2)        // Longest macro replay
+#define SETTLE_LIMIT    (MACRO_SCANS + 8 * SETTLE_SCANS)
+
+static uint8_t nvram[16];
+static bool usbMode;
+
+uint8_t ReadNvram(uint8_t offset)
+{
+    return nvram[offset];
+}
+
+void WriteNvram(uint8_t offset, uint8_t value)
+{
+    nvram[offset] = value;
+}
+
+uint8_t CurrentProfile(void)
+{
+    return 0;
+}
+
+bool isUSBMode(void)
+{
+    return usbMode;
+}
+
+bool isBusPowered(void)
+{
+    return usbMode;
+}
+
+static uint8_t* report;         // Allocated with its exact size so that ASan catches overruns.
+static int8_t xmit;
+static uint16_t macroScans;     // Scans since the current macro started
+
+static void fail(const char* message);
+
+// Follows APP_KeyboardScan(). The keys are pressed by onPressed() before
+// this is called, unless a macro is being sent.
+static void scan(void)
+{
+    if (xmit == XMIT_IN_ORDER) {
+        uint8_t key = peekMacro();
+        uint8_t mod = 0;
+#if APP_MACHINE_VALUE != 0x4550
+        if (key == KEYPAD_PERCENT) {
+            key = KEY_5;
+            mod = MOD_LEFTSHIFT;
+        }
+#endif
+        if (report[2] && report[2] == key)
+            report[2] = 0;      // BRK
+        else {
+            getMacro();
+            report[2] = key;
+            report[0] = mod;
+            if (!report[2])
+                xmit = XMIT_NONE;
+        }
+        if (MACRO_SCANS < ++macroScans)
+            fail("runaway macro");
+        return;
+    }
+
+    xmit = makeReport(report);
+    switch (xmit) {
+    case XMIT_NONE:
+    case XMIT_NORMAL:
+        break;
+    case XMIT_BRK:
+        memset(report + 2, 0, 6);
+        break;
+    case XMIT_IN_ORDER:
+        for (uint8_t i = 0; i < 6; ++i)
+            emitKey(report[2 + i]);
+        report[2] = beginMacro(6);
+        memset(report + 3, 0, 5);
+        macroScans = 0;
+        break;
+    case XMIT_MACRO:
+        xmit = XMIT_IN_ORDER;
+        report[0] = 0;
+        report[2] = beginMacro(MAX_MACRO_SIZE);
+        memset(report + 3, 0, 5);
+        macroScans = 0;
+        break;
+    default:
+        fail("unknown xmit");
+        break;
+    }
+}
+
+// Release all the keys, and wait until nothing has been sent for
+// SETTLE_SCANS scans in a row.
+static void settle(void)
+{
+    uint16_t quiet = 0;
+
+    for (uint16_t i = 0; quiet < SETTLE_SCANS; ++i) {
+        if (SETTLE_LIMIT < i)
+            fail("report does not settle");
+        scan();
+        quiet = (xmit == XMIT_NONE) ? quiet + 1 : 0;
+    }
+    for (uint8_t i = 2; i < 8; ++i) {
+        if (report[i] && report[i] != VOID_KEY)
+            fail("key left pressed");
+    }
+    if (report[0] & ~(prefix_shift ? prefix : 0))
+        fail("modifier left pressed");
+}
+
+static void reset(void)
+{
+    memcpy(nvram, nvram_initial_data, NVRAM_INITIAL_DATA_SIZE);
+    memset(nvram + NVRAM_INITIAL_DATA_SIZE, 0, sizeof nvram - NVRAM_INITIAL_DATA_SIZE);
+    usbMode = true;
+    prefix = 0;
+    initKeyboard();
+    controlLED(0);
+    beginMacro(0);      // Rewind the macro buffer.
+    getMacro();
+    memset(report, 0, 8);
+    xmit = XMIT_NONE;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    const uint8_t* end = data + size;
+
+    if (!report)
+        report = malloc(8);
+    reset();
+    while (data < end) {
+        uint8_t op = *data++;
+        if (op < 0xe0) {
+            uint8_t n = op & 7;
+            uint8_t repeat = ((op >> 3) & 3) + 1;
+            const uint8_t* codes = data;
+            if (end - data < n)
+                n = end - data;
+            data += n;
+            while (repeat--) {
+                if (xmit != XMIT_IN_ORDER) {
+                    for (uint8_t i = 0; i < n; ++i)
+                        onPressed((codes[i] % 96) / 12, (codes[i] % 96) % 12);
+                }
+                scan();
+            }
+        } else if (op <= 0xe8) {
+            if (data < end) {
+                WriteNvram(EEPROM_BASE + (op & 0x0f), *data++);
+                settle();       // Settings are changed only between keystrokes.
+                initKeyboard();
+            }
+        } else if (op == 0xf0) {
+            if (data < end)
+                controlLED(*data++);
+        } else if (op == 0xf1) {
+            usbMode = !usbMode;
+        } else {
+            settle();
+        }
+    }
+    settle();
+    return 0;
+}
+
+#ifdef FUZZER
+
+static void fail(const char* message)
+{
+    fprintf(stderr, "keyboard_fuzz: %s\n", message);
+    abort();
+}
+
+#else
+
+#define INPUT_MAX   1024
+#define RUNS        20000
+
+static const uint8_t* input;
+static size_t inputSize;
+static bool quiet;
+
+static void fail(const char* message)
+{
+    if (!quiet) {
+        fprintf(stderr, "keyboard_fuzz: %s\n", message);
+        FILE* f = fopen("keyboard_fuzz.crash", "wb");
+        if (f) {
+            fwrite(input, 1, inputSize, f);
+            fclose(f);
+            fprintf(stderr, "keyboard_fuzz: input written to keyboard_fuzz.crash\n");
+        }
+    }
+    abort();
+}
+
+static void run(const uint8_t* data, size_t size)
+{
+    input = data;
+    inputSize = size;
+    LLVMFuzzerTestOneInput(data, size);
+}
+
+static uint32_t seed = 1;
+
+static uint32_t xorshift(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static size_t readFile(const char* path, uint8_t* data)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        exit(2);
+    }
+    size_t size = fread(data, 1, INPUT_MAX, f);
+    fclose(f);
+    return size;
+}
+
+// Return non-zero if the input fails, running it in a child process so
+// that the hidden state of the keyboard core does not carry over.
+static int fails(const uint8_t* data, size_t size)
+{
+    int status;
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        quiet = true;
+        run(data, size);
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+    return !WIFEXITED(status) || WEXITSTATUS(status);
+}
+
+// Remove chunks of the input, halving the chunk size, while it still fails.
+static int minimize(const char* path)
+{
+    static uint8_t data[INPUT_MAX];
+    static uint8_t trial[INPUT_MAX];
+    size_t size = readFile(path, data);
+
+    if (!fails(data, size)) {
+        fprintf(stderr, "keyboard_fuzz: %s does not fail\n", path);
+        return 1;
+    }
+    for (size_t chunk = size / 2; 0 < chunk; chunk /= 2) {
+        for (size_t at = 0; at + chunk <= size;) {
+            memcpy(trial, data, at);
+            memcpy(trial + at, data + at + chunk, size - at - chunk);
+            if (fails(trial, size - chunk)) {
+                size -= chunk;
+                memcpy(data, trial, size);
+            } else {
+                at += chunk;
+            }
+        }
+    }
+    FILE* f = fopen("keyboard_fuzz.min", "wb");
+    if (!f) {
+        perror("keyboard_fuzz.min");
+        return 2;
+    }
+    fwrite(data, 1, size, f);
+    fclose(f);
+    printf("keyboard_fuzz: %zu bytes written to keyboard_fuzz.min\n", size);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    static uint8_t data[INPUT_MAX];
+
+    if (argc == 3 && !strcmp(argv[1], "-m"))
+        return minimize(argv[2]);
+    if (1 < argc) {
+        for (int i = 1; i < argc; ++i)
+            run(data, readFile(argv[i], data));
+        return 0;
+    }
+    for (uint32_t i = 0; i < RUNS; ++i) {
+        size_t size = xorshift() % INPUT_MAX;
+        for (size_t j = 0; j < size; ++j) {
+            uint32_t r = xorshift();
+            // Favor frames of up to 3 keys, so that the Fn combinations and
+            // the kana sequences are reached more often than ghosting.
+            data[j] = (r & 0x300) ? (uint8_t) (r % 0xe0 & ~4u) : (uint8_t) r;
+        }
+        run(data, size);
+    }
+    printf("keyboard_fuzz: %u inputs passed\n", RUNS);
+    return 0;
+}
+
+#endif
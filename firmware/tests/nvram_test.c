@@ -0,0 +1,290 @@
+/*
+ * Copyright 2026 Esrille Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Test of the NVRAM log of the nisse board (bsp/pic18f47j53_nisse/nvram.c)
+// against a simulated flash region. Like the PIC18F47J53 flash memory, a
+// write can only clear bits, and a word can be written only once after an
+// erase. A power loss is simulated by cutting a word write in half.
+//
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <system.h>
+#include <plib/flash.h>
+
+#define NVRAM_ADDRESS   0x1F800
+#define NVRAM_SIZE      1024
+#define NVRAM_BLOCK     64
+#define NVRAM_LOG       NVRAM_BLOCK
+#define RECORD_SIZE     4
+
+#define CHECK(cond) \
+    do { if (!(cond)) { fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while (0)
+
+NVRAM_DATA(1, 2, 3, 4, 5, 6, 7, 8);
+
+uint8_t nvramArray[NVRAM_SIZE];    // Read directly by nvram.c as if memory-mapped
+
+static uint8_t* flash = nvramArray;
+static unsigned reads;          // ReadFlash() calls
+static int writesLeft = -1;     // Word writes left until the power is lost; -1 for never
+static jmp_buf powerLost;
+
+__typeof__(WDTCONbits) WDTCONbits;
+
+bool isUSBMode(void)
+{
+    return false;
+}
+
+bool isBusPowered(void)
+{
+    return false;
+}
+
+void ReadFlash(unsigned long startaddr, unsigned int num_bytes, unsigned char* flash_array)
+{
+    CHECK(NVRAM_ADDRESS <= startaddr && startaddr + num_bytes <= NVRAM_ADDRESS + NVRAM_SIZE);
+    memcpy(flash_array, flash + (startaddr - NVRAM_ADDRESS), num_bytes);
+    ++reads;
+}
+
+void EraseFlash(unsigned long startaddr, unsigned long endaddr)
+{
+    CHECK(NVRAM_ADDRESS <= startaddr && endaddr <= NVRAM_ADDRESS + NVRAM_SIZE);
+    memset(flash + (startaddr - NVRAM_ADDRESS), 0xff, endaddr - startaddr);
+}
+
+void WriteBlockFlash(unsigned long startaddr, unsigned char num_blocks, unsigned char* flash_array)
+{
+    uint8_t* p = flash + (startaddr - NVRAM_ADDRESS);
+
+    CHECK(NVRAM_ADDRESS <= startaddr && startaddr + NVRAM_BLOCK * num_blocks <= NVRAM_ADDRESS + NVRAM_SIZE);
+    for (unsigned i = 0; i < NVRAM_BLOCK * num_blocks; ++i)
+        p[i] &= flash_array[i];
+}
+
+void WriteWordFlash(unsigned long startaddr, unsigned int data)
+{
+    uint8_t* p = flash + (startaddr - NVRAM_ADDRESS);
+
+    CHECK(NVRAM_ADDRESS <= startaddr && startaddr + 2 <= NVRAM_ADDRESS + NVRAM_SIZE);
+    CHECK(p[0] == 0xff && p[1] == 0xff);
+    if (writesLeft == 0) {
+        p[0] &= data;       // Only the low byte made it.
+        longjmp(powerLost, 1);
+    }
+    if (0 < writesLeft)
+        --writesLeft;
+    p[0] &= data;
+    p[1] &= data >> 8;
+}
+
+static void erase(void)
+{
+    memset(flash, 0xff, NVRAM_SIZE);
+}
+
+// Settings expected in each profile, and the current profile
+static uint8_t model[PROFILE_MAX][PROFILE_SIZE];
+static uint8_t modelGlobal[GLOBAL_SIZE];
+static uint8_t modelCurrent;
+
+static void resetModel(void)
+{
+    memset(model, 0, sizeof model);
+    for (int p = 0; p < PROFILE_MAX; ++p)
+        memcpy(model[p], nvram_initial_data, NVRAM_INITIAL_DATA_SIZE);
+    memset(modelGlobal, 0, sizeof modelGlobal);
+    modelCurrent = 0;
+}
+
+static void checkModel(void)
+{
+    CHECK(CurrentProfile() == modelCurrent);
+    for (int p = 0; p < PROFILE_MAX; ++p) {
+        for (int offset = 0; offset < PROFILE_SIZE; ++offset)
+            CHECK(ReadProfileNvram(p, offset) == model[p][offset]);
+    }
+    for (int offset = 0; offset < GLOBAL_SIZE; ++offset)
+        CHECK(ReadGlobalNvram(offset) == modelGlobal[offset]);
+}
+
+static void write(int profile, int offset, uint8_t value)
+{
+    if (offset < PROFILE_SIZE) {
+        WriteProfileNvram(profile, offset, value);
+        model[profile][offset] = value;
+    } else {
+        WriteGlobalNvram(offset - PROFILE_SIZE, value);
+        modelGlobal[offset - PROFILE_SIZE] = value;
+    }
+}
+
+// Random changes with remounts, through both PollNvram() and FlushNvram(),
+// across many compactions.
+static void testRandom(void)
+{
+    erase();
+    resetModel();
+    InitNvram();
+    checkModel();
+    srand(1);
+    for (int i = 0; i < 20000; ++i) {
+        write(rand() % PROFILE_MAX, rand() % (PROFILE_SIZE + GLOBAL_SIZE), rand());
+        if (rand() % 8 == 0) {
+            modelCurrent = rand() % PROFILE_MAX;
+            SelectProfile(modelCurrent);
+        }
+        if (rand() % 3 == 0)
+            FlushNvram();
+        else
+            for (int k = 0; k < 70; ++k)
+                PollNvram();
+        if (rand() % 50 == 0) {
+            FlushNvram();
+            reads = 0;
+            InitNvram();
+            CHECK(reads == 1);      // The snapshot block only
+            checkModel();
+        }
+    }
+}
+
+// Cut the power at every word write of a run of changes, and check that
+// each setting is either the old or the new value, and that a profile in
+// range is mounted.
+static void testPowerLoss(void)
+{
+    static uint8_t before[NVRAM_SIZE];
+
+    for (int cut = 0; ; ++cut) {
+        erase();
+        resetModel();
+        InitNvram();
+        for (int i = 0; i < 100; ++i)     // Fill part of the log.
+            write(i % PROFILE_MAX, i % PROFILE_SIZE, i);
+        FlushNvram();
+        memcpy(before, flash, NVRAM_SIZE);
+
+        uint8_t old = ReadProfileNvram(1, 3);
+        writesLeft = cut;
+        if (setjmp(powerLost) == 0) {
+            for (int i = 0; i < 8; ++i) {
+                WriteProfileNvram(1, 3, 200 + i);
+                FlushNvram();
+            }
+            writesLeft = -1;
+            break;      // No write was cut; every point has been tried.
+        }
+        writesLeft = -1;
+        InitNvram();
+        uint8_t value = ReadProfileNvram(1, 3);
+        CHECK(value == old || 200 <= value && value < 208);
+        CHECK(CurrentProfile() < PROFILE_MAX);
+        for (int p = 0; p < PROFILE_MAX; ++p) {
+            for (int offset = 0; offset < PROFILE_SIZE; ++offset) {
+                if (p != 1 || offset != 3)
+                    CHECK(ReadProfileNvram(p, offset) == model[p][offset]);
+            }
+        }
+
+        // The log keeps working after the power loss.
+        WriteProfileNvram(1, 3, 42);
+        FlushNvram();
+        InitNvram();
+        CHECK(ReadProfileNvram(1, 3) == 42);
+    }
+}
+
+// A record torn between its two words is skipped, and so is a slot whose
+// index word was never written.
+static void testTornRecord(void)
+{
+    int tail;
+
+    erase();
+    InitNvram();
+    WriteNvram(3, 42);
+    FlushNvram();
+    WriteNvram(3, 43);
+    FlushNvram();
+    for (tail = NVRAM_LOG; flash[tail] != 0xff; tail += RECORD_SIZE)
+        ;
+    tail -= RECORD_SIZE;
+    flash[tail + 2] = flash[tail + 3] = 0xff;    // Erase the check word of the last record.
+    InitNvram();
+    CHECK(ReadNvram(3) == 42);
+    WriteNvram(3, 44);
+    FlushNvram();
+    InitNvram();
+    CHECK(ReadNvram(3) == 44);
+
+    for (tail = NVRAM_LOG; flash[tail] != 0xff; tail += RECORD_SIZE)
+        ;
+    flash[tail + 1] = 0x12;     // Half-written slot with its index erased
+    InitNvram();
+    WriteNvram(3, 45);
+    FlushNvram();
+    InitNvram();
+    CHECK(ReadNvram(3) == 45);
+}
+
+// A block written by the firmware before the log, with 10-byte profiles
+static void testLegacyBlock(void)
+{
+    erase();
+    for (int i = 0; i < 40; ++i)
+        flash[i] = i;
+    flash[NVRAM_BLOCK - 2] = 2;     // current_profile
+    flash[NVRAM_BLOCK - 1] = 0x01;  // sig
+    InitNvram();
+    CHECK(CurrentProfile() == 2);
+    CHECK(ReadNvram(0) == 20 && ReadNvram(9) == 29 && ReadNvram(10) == 0);
+    WriteNvram(1, 99);
+    FlushNvram();
+    InitNvram();
+    CHECK(ReadNvram(1) == 99 && ReadNvram(0) == 20);
+    SelectProfile(3);
+    CHECK(ReadNvram(9) == 39);
+}
+
+// A block with any other signature is not loaded, and the defaults are used.
+static void testUnknownBlock(void)
+{
+    erase();
+    for (int i = 0; i < 40; ++i)
+        flash[i] = i;
+    flash[NVRAM_BLOCK - 2] = 2;     // current_profile
+    flash[NVRAM_BLOCK - 1] = 0x02;  // sig
+    InitNvram();
+    CHECK(CurrentProfile() == 0);
+    CHECK(ReadNvram(0) == nvram_initial_data[0] && ReadNvram(1) == nvram_initial_data[1]);
+}
+
+int main(void)
+{
+    testRandom();
+    testPowerLoss();
+    testTornRecord();
+    testLegacyBlock();
+    testUnknownBlock();
+    printf("nvram_test: passed\n");
+    return 0;
+}
@@ -0,0 +1,263 @@
+#!/usr/bin/env python3
+#
+# Copyright 2026 Esrille Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Test of ../tools/profiles.py against simulated keyboards.
+
+The hid module is replaced by FakeHid before profiles.py is imported.  Like
+app_device_keyboard.c, a FakeKeyboard keeps the profiles report of
+PROFILE_MAX profiles of PROFILE_SIZE bytes (nvram.h), ignores a report of
+another format, and stalls the reads for a while after a write until it has
+stored the profiles.  The profile file profiles.json is applied to two of
+them through main().
+"""
+
+import contextlib
+import io
+import json
+import os
+import sys
+import types
+
+PROFILE_MAX = 4
+PROFILE_SIZE = 12
+REPORT_SIZE = 4 + PROFILE_MAX * PROFILE_SIZE
+
+
+class FakeKeyboard:
+    def __init__(self, path, stall=3, writable=True):
+        profile = [1, 4, 0, 0, 0, 0, 0, 0x21, 0, 0xa5, 0x5a, 0xff]
+        self.report = bytes([1, PROFILE_MAX, PROFILE_SIZE, 0] + profile * PROFILE_MAX)
+        self.path = path
+        self.stall = stall
+        self.writable = writable
+        self.busy = 0
+        self.opened = False
+
+    def get_feature_report(self, report_id, length):
+        assert self.opened and report_id == 0 and REPORT_SIZE < length
+        if self.busy:
+            self.busy -= 1
+            raise IOError('stalled')
+        return [0] + list(self.report)
+
+    def send_feature_report(self, data):
+        assert self.opened and data[0] == 0
+        report = bytes(data[1:])
+        if self.writable and len(report) == REPORT_SIZE and report[:3] == self.report[:3]:
+            self.report = report
+        self.busy = self.stall
+        return len(data)
+
+
+class FakeHid(types.ModuleType):
+    def __init__(self):
+        super().__init__('hid')
+        self.keyboards = {}
+        self.interfaces = []
+
+    def attach(self, keyboard, vendor_id=0x04D8, product_id=0xF550):
+        # A keyboard with the mouse: the boot keyboard, the mouse and the
+        # profiles interfaces.  Only the last one is a profiles one.
+        self.keyboards[keyboard.path] = keyboard
+        for usage_page, usage, interface in ((0x01, 0x06, 0), (0x01, 0x02, 1), (0xFF00, 0x01, 2)):
+            self.interfaces.append({
+                'vendor_id': vendor_id, 'product_id': product_id,
+                'usage_page': usage_page, 'usage': usage,
+                'interface_number': interface,
+                'path': keyboard.path if usage_page == 0xFF00 else keyboard.path + b'-%d' % interface,
+            })
+
+    def enumerate(self, vendor_id=0, product_id=0):
+        return [d for d in self.interfaces
+                if d['vendor_id'] == vendor_id and d['product_id'] == product_id]
+
+    def device(self):
+        hid = self
+
+        class Device:
+            keyboard = None
+
+            def open_path(self, path):
+                if path not in hid.keyboards:
+                    raise IOError('open failed')
+                self.keyboard = hid.keyboards[path]
+                self.keyboard.opened = True
+
+            def close(self):
+                if self.keyboard:
+                    self.keyboard.opened = False
+
+            def get_feature_report(self, report_id, length):
+                return self.keyboard.get_feature_report(report_id, length)
+
+            def send_feature_report(self, data):
+                return self.keyboard.send_feature_report(data)
+
+        return Device()
+
+
+def check(cond, message=''):
+    if not cond:
+        frame = sys._getframe(1)
+        sys.exit('%s:%d: %s' % (os.path.basename(frame.f_code.co_filename), frame.f_lineno, message))
+
+
+def raises(function, *args):
+    try:
+        function(*args)
+    except ValueError as e:
+        return str(e)
+    return None
+
+
+def test_decode(profiles):
+    report = FakeKeyboard(b'k').report
+    config = profiles.decode(report)
+    check(config['current'] == 0)
+    check(len(config['profiles']) == PROFILE_MAX)
+    check(config['profiles'][0] == {'base': 1, 'kana': 4, 'os': 0, 'delay': 0, 'mod': 0,
+                                    'led': 0, 'ime': 0, 'pad': 1, 'curve': 2, 'prefix': 0},
+          config['profiles'][0])
+    check(profiles.encode(report, config) == report, 'the round trip changed the report')
+
+
+def test_encode(profiles):
+    report = FakeKeyboard(b'k').report
+    encoded = profiles.encode(report, {'current': 3, 'profiles': [{}, {'pad': 3}, {'curve': 0, 'os': 2}]})
+    check(encoded[3] == 3)
+    at = 4 + PROFILE_SIZE
+    check(encoded[at + 7] == 0x23, 'pad must keep the curve')
+    at += PROFILE_SIZE
+    check(encoded[at + 7] == 0x01, 'curve must keep the pad')
+    check(encoded[at + 2] == 2)
+    # The unused bytes are left as read.
+    check(all(encoded[4 + p * PROFILE_SIZE + 9:4 + (p + 1) * PROFILE_SIZE] == b'\xa5\x5a\xff'
+              for p in range(PROFILE_MAX)))
+    config = profiles.decode(encoded)
+    check(config['profiles'][1]['pad'] == 3 and config['profiles'][1]['curve'] == 2)
+    check(config['profiles'][2]['pad'] == 1 and config['profiles'][2]['curve'] == 0)
+
+
+def test_errors(profiles):
+    report = FakeKeyboard(b'k').report
+    for config in ({'current': PROFILE_MAX}, {'current': -1},
+                   {'profiles': [{}] * (PROFILE_MAX + 1)},
+                   {'profiles': [{'mouse': 1}]},
+                   {'profiles': [{'pad': 4}]},
+                   {'profiles': [{'curve': 4}]},
+                   {'profiles': [{'curve': -1}]},
+                   {'profiles': [{'base': 256}]},
+                   {'profiles': [{'os': '1'}]}):
+        check(raises(profiles.encode, report, config), 'no error for %s' % config)
+    # A profile shorter than EEPROM_PREFIX does not have the prefix setting.
+    short = bytes([1, 1, 8, 0]) + bytes(8)
+    check('prefix' not in profiles.decode(short)['profiles'][0])
+    check(raises(profiles.encode, short, {'profiles': [{'prefix': 0}]}))
+
+
+def test_keyboards(profiles, hid):
+    check(profiles.keyboards() == [b'kbd0', b'kbd1'], profiles.keyboards())
+    hid.attach(FakeKeyboard(b'other'), product_id=0xF551)
+    check(profiles.keyboards() == [b'kbd0', b'kbd1'], 'another product was listed')
+
+
+def test_apply(profiles, hid):
+    # The read-back is retried while the keyboard stalls it.
+    keyboard = FakeKeyboard(b'slow', stall=20)
+    hid.keyboards[keyboard.path] = keyboard
+    check(profiles.apply(b'slow', {'profiles': [{'delay': 2}]}) is None)
+    check(keyboard.report[4 + 3] == 2 and not keyboard.opened)
+    keyboard.stall = 1000
+    check(profiles.apply(b'slow', {'profiles': [{'delay': 1}]}) == 'stalled')
+
+    keyboard = FakeKeyboard(b'ro', writable=False)
+    hid.keyboards[keyboard.path] = keyboard
+    check(profiles.apply(b'ro', {'profiles': [{'delay': 2}]}) == 'verify failed')
+    check(profiles.apply(b'ro', {'profiles': [{'pad': 9}]}) == 'profile 0: pad out of range')
+    check(profiles.apply(b'none', {}) == 'open failed')
+
+    keyboard = FakeKeyboard(b'v2')
+    keyboard.report = bytes([2]) + keyboard.report[1:]
+    hid.keyboards[keyboard.path] = keyboard
+    check(profiles.apply(b'v2', {}) == 'unknown profiles report format')
+
+
+def run_main(profiles, *args):
+    argv, sys.argv = sys.argv, ['profiles.py'] + list(args)
+    out = io.StringIO()
+    try:
+        with contextlib.redirect_stdout(out):
+            status = profiles.main()
+    finally:
+        sys.argv = argv
+    return status, out.getvalue()
+
+
+def test_main(profiles, hid):
+    file = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'profiles.json')
+    with open(file) as f:
+        config = json.load(f)
+
+    status, out = run_main(profiles, 'list')
+    check(status == 0 and out.split() == ['kbd0', 'kbd1'], out)
+
+    status, out = run_main(profiles, 'apply', file)
+    check(status == 0 and out.split('\n')[:2] == ['kbd0: ok', 'kbd1: ok'], out)
+    for path in (b'kbd0', b'kbd1'):
+        status, out = run_main(profiles, 'read', '--path', path.decode())
+        read = json.loads(out)
+        check(status == 0 and read['current'] == config['current'])
+        for settings, stored in zip(config['profiles'], read['profiles']):
+            check(all(stored[name] == value for name, value in settings.items()), stored)
+        # The profiles not in the file are left as they were.
+        check(read['profiles'][2:] == profiles.decode(FakeKeyboard(b'k').report)['profiles'][2:])
+
+    # Applying the same file again changes nothing, even if it cannot be written.
+    hid.keyboards[b'kbd1'].writable = False
+    status, out = run_main(profiles, 'apply', '--path', 'kbd1', file)
+    check(status == 0 and out == 'kbd1: ok\n', out)
+
+    file = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'profiles.out')
+    with open(file, 'w') as f:
+        json.dump({'profiles': [{'delay': 3}]}, f)
+    status, out = run_main(profiles, 'apply', '--jobs', '1', file)
+    check(status == 1 and out == 'kbd0: ok\nkbd1: verify failed\n1 of 2 keyboards failed\n', out)
+    os.remove(file)
+
+
+def main():
+    hid = FakeHid()
+    sys.modules['hid'] = hid
+    sys.dont_write_bytecode = True
+    sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'tools'))
+    import profiles
+    profiles.VERIFY_TIMEOUT = 0.2
+    profiles.VERIFY_INTERVAL = 0.001
+    hid.attach(FakeKeyboard(b'kbd0'))
+    hid.attach(FakeKeyboard(b'kbd1'))
+
+    test_decode(profiles)
+    test_encode(profiles)
+    test_errors(profiles)
+    test_keyboards(profiles, hid)
+    test_apply(profiles, hid)
+    test_main(profiles, hid)
+    print('profiles_test: passed')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,438 @@
+/*
+ * Copyright 2026 Esrille Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Worst-case cost of makeReport() for each stage of the scan, estimated on
+// the host. The keyboard core is built with -fsanitize-coverage=trace-pc
+// so that each basic block it runs calls __sanitizer_cov_trace_pc(), and
+// the blocks run by each makeReport() call are counted for
+//
+//   keys       every key of the matrix alone, with Shift, and with Num Lock
+//   rollover   six keys of a row and the left modifiers at once
+//   ghost      three corners of a rectangle of the matrix
+//   kana       every key alone and with each thumb key in kana mode
+//   command    every key with Fn, including the dumps like Fn+F1
+//
+// under the combinations of the settings that the code of each stage reads.
+// The IME only matters in kana mode and to the names the dumps print, so
+// the typing stages are run with it at 0, and only the commands of the top
+// row, which include the dumps, are run under every combination. In kana
+// mode, the base layouts differ only in isJP() and the OSes in is109(), so
+// QWERTY and JIS, and PC and 109A stand for the others there. The worst
+// frame of each stage is printed with its settings and its estimated cost of
+// blocks * TCY_PER_BLOCK instruction cycles, and the exit status is 1 if
+// the estimate exceeds SCAN_BUDGET for the typing stages, or
+// COMMAND_BUDGET for the command stage, which runs once per Fn command.
+//
+// makeReport() is what the ENABLE_SCAN_PROFILE build times on the target
+// with Timer3, and the SCAN line of its Fn+F1 dump gives the cycles of the
+// slowest scan. Calibrate TCY_PER_BLOCK by dividing it by the blocks this
+// tool prints for the same frame. The estimate does not know the cost of
+// the multiplications and divisions that the PIC18 does in software, so
+// leave a margin for them.
+//
+// "make check" runs this tool, and the limits above can be given there as
+// "make check WCET='-DTCY_PER_BLOCK=30 -DSCAN_BUDGET=12000'".
+//
+
+#include <Keyboard.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <system.h>
+
+#ifndef TCY_PER_BLOCK
+#define TCY_PER_BLOCK   24u     // [Tcy] Mean cost of a basic block with XC8
+#endif
+#ifndef SCAN_BUDGET
+#define SCAN_BUDGET     12000u  // [Tcy] 1 msec at 48 MHz, as in KeyboardCommon.c
+#endif
+#ifndef COMMAND_BUDGET
+#define COMMAND_BUDGET  120000u // [Tcy] 10 msec at 48 MHz
+#endif
+
+#define ROWS            8
+#define COLUMNS         12
+
+static unsigned long blocks;
+static int counting;
+
+__attribute__((no_sanitize_coverage))
+void __sanitizer_cov_trace_pc(void)
+{
+    if (counting)
+        ++blocks;
+}
+
+static uint8_t nvram[16];
+
+uint8_t ReadNvram(uint8_t offset)
+{
+    return nvram[offset];
+}
+
+void WriteNvram(uint8_t offset, uint8_t value)
+{
+    nvram[offset] = value;
+}
+
+uint8_t CurrentProfile(void)
+{
+    return 0;
+}
+
+bool isUSBMode(void)
+{
+    return true;
+}
+
+bool isBusPowered(void)
+{
+    return true;
+}
+
+//
+// Settings
+//
+
+enum {
+    SETTING_BASE,
+    SETTING_OS,
+    SETTING_MOD,
+    SETTING_KANA,
+    SETTING_IME,
+    SETTING_PREFIX,
+    SETTING_COUNT
+};
+
+static const struct {
+    const char* name;
+    uint8_t offset;
+    uint8_t max;
+} settings[SETTING_COUNT] = {
+    { "base", EEPROM_BASE, BASE_MAX },
+    { "os", EEPROM_OS, OS_MAX },
+    { "mod", EEPROM_MOD, MOD_MAX },
+    { "kana", EEPROM_KANA, KANA_MAX },
+    { "ime", EEPROM_IME, IME_MAX },
+    { "prefix", EEPROM_PREFIX, PREFIXSHIFT_MAX },
+};
+
+static uint8_t setting[SETTING_COUNT];
+
+static void loadSettings(void)
+{
+    memcpy(nvram, nvram_initial_data, NVRAM_INITIAL_DATA_SIZE);
+    memset(nvram + NVRAM_INITIAL_DATA_SIZE, 0, sizeof nvram - NVRAM_INITIAL_DATA_SIZE);
+    for (int i = 0; i < SETTING_COUNT; ++i)
+        nvram[settings[i].offset] = setting[i];
+    nvram[EEPROM_DELAY] = DELAY_0;  // The delay only changes which scan a key is taken at.
+    initKeyboard();
+}
+
+// Step to the next combination of the settings. Return 0 after the last.
+static int nextSettings(void)
+{
+    for (int i = 0; i < SETTING_COUNT; ++i) {
+        if (++setting[i] <= settings[i].max)
+            return 1;
+        setting[i] = 0;
+    }
+    return 0;
+}
+
+//
+// Scans
+//
+
+typedef struct Key {
+    int8_t row;
+    uint8_t column;
+} Key;
+
+#define FRAME_MAX   16
+
+typedef struct Frame {
+    uint8_t count;
+    Key keys[FRAME_MAX];
+} Frame;
+
+// Keys found by their place in matrixQwerty, as mapped by codeRev2
+static const Key keyFn = { 4, 0 };
+static const Key keyShift = { 5, 0 };
+static const Key keyLang1 = { 7, 6 };   // Fn+LANG1 enters kana mode
+static const Key keyLang2 = { 7, 5 };   // and Fn+LANG2 leaves it.
+
+// Left Control, GUI, Shift and Alt, which share a column so that they are
+// not taken for ghosts together with the keys of a row
+static const Key modifierKeys[] = {
+    { 2, 0 }, { 3, 0 }, { 5, 0 }, { 7, 0 },
+};
+
+// The bottom row of matrixQwerty, where the thumb keys of the kana
+// layouts are, except Fn
+static const Key thumbKeys[] = {
+    { 2, 0 }, { 3, 0 }, { 5, 0 }, { 6, 0 }, { 7, 0 },
+    { 2, 11 }, { 3, 11 }, { 5, 11 }, { 6, 11 }, { 7, 11 },
+};
+
+static uint8_t report[8];
+static int8_t xmit;
+
+// Follows APP_KeyboardScan(), and return the blocks run by makeReport().
+static unsigned long scan(const Frame* frame)
+{
+    unsigned long count;
+
+    if (xmit == XMIT_IN_ORDER) {
+        uint8_t key = peekMacro();
+        if (report[2] && report[2] == key)
+            report[2] = 0;      // BRK
+        else {
+            getMacro();
+            report[2] = key;
+            report[0] = 0;
+            if (!report[2])
+                xmit = XMIT_NONE;
+        }
+        return 0;
+    }
+
+    if (frame) {
+        for (uint8_t i = 0; i < frame->count; ++i)
+            onPressed(frame->keys[i].row, frame->keys[i].column);
+    }
+    blocks = 0;
+    counting = 1;
+    xmit = makeReport(report);
+    counting = 0;
+    count = blocks;
+    switch (xmit) {
+    case XMIT_BRK:
+        memset(report + 2, 0, 6);
+        break;
+    case XMIT_IN_ORDER:
+        for (uint8_t i = 0; i < 6; ++i)
+            emitKey(report[2 + i]);
+        report[2] = beginMacro(6);
+        memset(report + 3, 0, 5);
+        break;
+    case XMIT_MACRO:
+        xmit = XMIT_IN_ORDER;
+        report[0] = 0;
+        report[2] = beginMacro(MAX_MACRO_SIZE);
+        memset(report + 3, 0, 5);
+        break;
+    default:
+        break;
+    }
+    return count;
+}
+
+// Press the frame until it is taken, and release it. A macro it typed is
+// dropped rather than sent, as makeReport() is not called meanwhile. Return
+// the most blocks of a scan.
+static unsigned long press(const Frame* frame)
+{
+    unsigned long most = 0;
+
+    for (int i = 0; i < 4; ++i) {
+        unsigned long count = scan((i < 2) ? frame : NULL);
+        if (most < count)
+            most = count;
+        if (xmit == XMIT_IN_ORDER) {
+            beginMacro(0);      // Rewind the macro buffer.
+            getMacro();
+            memset(report, 0, sizeof report);
+            xmit = XMIT_NONE;
+        }
+    }
+    return most;
+}
+
+static void pressKeys(Key a, Key b)
+{
+    Frame frame = { 2, { a, b } };
+
+    press(&frame);
+}
+
+//
+// Stages
+//
+
+typedef struct Stage {
+    const char* name;
+    unsigned long budget;       // [Tcy]
+    unsigned long most;         // Blocks
+    Frame frame;
+    uint8_t setting[SETTING_COUNT];
+} Stage;
+
+enum {
+    STAGE_KEYS,
+    STAGE_ROLLOVER,
+    STAGE_GHOST,
+    STAGE_KANA,
+    STAGE_COMMAND,
+    STAGE_COUNT
+};
+
+static Stage stages[STAGE_COUNT] = {
+    { "keys", SCAN_BUDGET },
+    { "rollover", SCAN_BUDGET },
+    { "ghost", SCAN_BUDGET },
+    { "kana", SCAN_BUDGET },
+    { "command", COMMAND_BUDGET },
+};
+
+static void run(int s, const Frame* frame)
+{
+    unsigned long count = press(frame);
+    Stage* stage = &stages[s];
+
+    if (stage->most < count) {
+        stage->most = count;
+        stage->frame = *frame;
+        memcpy(stage->setting, setting, sizeof setting);
+    }
+}
+
+static void runCommand(Key key)
+{
+    Frame fn = { 2, { keyFn, key } };
+
+    run(STAGE_COMMAND, &fn);
+    pressKeys(keyFn, keyLang2);     // Leave kana mode if Fn+LANG1 entered it,
+    loadSettings();                 // and undo the settings the command changed.
+}
+
+static void runKeys(void)
+{
+    for (int8_t row = 0; row < ROWS; ++row) {
+        for (uint8_t column = 0; column < COLUMNS; ++column) {
+            Key key = { row, column };
+            Frame alone = { 1, { key } };
+            Frame shifted = { 2, { keyShift, key } };
+
+            run(STAGE_KEYS, &alone);
+            run(STAGE_KEYS, &shifted);
+            if (row)
+                runCommand(key);
+        }
+    }
+
+    // Num Lock remaps the right half of the keys.
+    controlLED(LED_NUM_LOCK);
+    for (int8_t row = 0; row < ROWS; ++row) {
+        for (uint8_t column = 0; column < COLUMNS; ++column) {
+            Frame alone = { 1, { { row, column } } };
+            run(STAGE_KEYS, &alone);
+        }
+    }
+    controlLED(0);
+}
+
+// Fn+F1 to Fn+F9 and the rest of the top row
+static void runTopRow(void)
+{
+    for (uint8_t column = 0; column < COLUMNS; ++column)
+        runCommand((Key) { 0, column });
+}
+
+static void runRollover(void)
+{
+    Frame frame = { 0 };
+
+    for (uint8_t i = 0; i < sizeof modifierKeys / sizeof modifierKeys[0]; ++i)
+        frame.keys[frame.count++] = modifierKeys[i];
+    for (uint8_t column = 1; column < 7; ++column)
+        frame.keys[frame.count++] = (Key) { 5, column };
+    run(STAGE_ROLLOVER, &frame);
+}
+
+static void runGhost(void)
+{
+    Frame frame = { 3, { { 4, 1 }, { 4, 2 }, { 5, 1 } } };
+
+    run(STAGE_GHOST, &frame);
+    frame.keys[frame.count++] = (Key) { 5, 2 };
+    run(STAGE_GHOST, &frame);
+}
+
+static void runKana(void)
+{
+    if (setting[SETTING_KANA] == KANA_ROMAJI)
+        return;     // No kana mode
+    if (setting[SETTING_BASE] != BASE_QWERTY && setting[SETTING_BASE] != BASE_JIS ||
+        setting[SETTING_OS] != OS_PC && setting[SETTING_OS] != OS_109A)
+        return;
+    pressKeys(keyFn, keyLang1);
+    for (int8_t row = 0; row < ROWS; ++row) {
+        for (uint8_t column = 0; column < COLUMNS; ++column) {
+            Key key = { row, column };
+            Frame alone = { 1, { key } };
+
+            run(STAGE_KANA, &alone);
+            for (uint8_t i = 0; i < sizeof thumbKeys / sizeof thumbKeys[0]; ++i) {
+                Frame thumb = { 2, { thumbKeys[i], key } };
+                run(STAGE_KANA, &thumb);
+            }
+        }
+    }
+    pressKeys(keyFn, keyLang2);
+}
+
+static void printStage(const Stage* stage)
+{
+    unsigned long tcy = stage->most * TCY_PER_BLOCK;
+
+    printf("%-8s %6lu %8lu %8lu  %s ", stage->name, stage->most, tcy, stage->budget,
+           (tcy <= stage->budget) ? "ok  " : "OVER");
+    for (int i = 0; i < SETTING_COUNT; ++i)
+        printf(" %s=%u", settings[i].name, stage->setting[i]);
+    printf("  keys");
+    for (uint8_t i = 0; i < stage->frame.count; ++i)
+        printf(" %u/%u", stage->frame.keys[i].row, stage->frame.keys[i].column);
+    printf("\n");
+}
+
+int main(void)
+{
+    int over = 0;
+
+    memset(setting, 0, sizeof setting);
+    do {
+        loadSettings();
+        if (!setting[SETTING_IME]) {
+            runKeys();
+            runRollover();
+            runGhost();
+        }
+        runTopRow();
+        runKana();
+    } while (nextSettings());
+
+    printf("stage    blocks    [Tcy]   budget       worst case (row/column)\n");
+    for (int s = 0; s < STAGE_COUNT; ++s) {
+        printStage(&stages[s]);
+        if (stages[s].budget < stages[s].most * TCY_PER_BLOCK)
+            over = 1;
+    }
+    return over;
+}
@@ -0,0 +1,27 @@
+/*
+ * Copyright 2026 Esrille Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLASH_H
+#define FLASH_H
+
+// The plib flash functions used by nvram.c, simulated by nvram_test.c
+
+void ReadFlash(unsigned long startaddr, unsigned int num_bytes, unsigned char* flash_array);
+void EraseFlash(unsigned long startaddr, unsigned long endaddr);
+void WriteBlockFlash(unsigned long startaddr, unsigned char num_blocks, unsigned char* flash_array);
+void WriteWordFlash(unsigned long startaddr, unsigned int data);
+
+#endif  // FLASH_H
@@ -0,0 +1,28 @@
+/*
+ * Copyright 2026 Esrille Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PPS_H
+#define PPS_H
+
+// The peripheral pin select macros of the peripheral library, which have
+// nothing to do on the host.
+
+#define PPSUnLock()
+#define PPSLock()
+#define iPPSInput(fn, pin)
+#define iPPSOutput(pin, fn)
+
+#endif  // PPS_H
@@ -0,0 +1,35 @@
+/*
+ * Copyright 2026 Esrille Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SPI_H
+#define SPI_H
+
+// The SPI2 functions of the peripheral library used by HosMaster.c. They
+// are defined by hos_sim.c, which clocks each byte through the simulated
+// BLE module.
+
+#define SPI_FOSC_4      0x00
+#define SPI_FOSC_16     0x01
+#define SPI_FOSC_64     0x02
+
+#define MODE_00         0
+#define SMPMID          0x00
+
+void OpenSPI2(unsigned char sync_mode, unsigned char bus_mode, unsigned char smp_phase);
+void CloseSPI2(void);
+signed char WriteSPI2(unsigned char data_out);
+
+#endif  // SPI_H
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2026 Esrille Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SYSTEM_H
+#define SYSTEM_H
+
+//
+// Host build of the firmware sources for the tests. It stands in for the
+// system.h of the nisse board, together with the buttons.h, leds.h and
+// nvram.h of its bsp. The functions declared here and in those headers are
+// defined by nvram.c or by the tests.
+//
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <xc.h>
+#include <buttons.h>
+#include <leds.h>
+#include <nvram.h>
+
+#ifdef WITH_HOS
+#include <HosMaster.h>
+#include <HosTasks.h>
+#endif
+
+#ifndef APP_MACHINE_VALUE
+#define APP_MACHINE_VALUE       0x4753
+#endif
+#define APP_VERSION_VALUE       0x0000
+#define BOARD_REV_VALUE         6
+
+#define _XTAL_FREQ              48000000
+#define WDT_FREQ                60u
+
+#ifdef ENABLE_MOUSE
+#define HOS_TYPE_DEFAULT        HOS_TYPE_TSAP
+#else
+#define HOS_TYPE_DEFAULT        HOS_TYPE_INFO
+#endif
+
+#define LED_USB_DEVICE_HID_KEYBOARD_CAPS_LOCK   0x02
+
+bool isUSBMode(void);
+bool isBusPowered(void);
+
+#endif  // SYSTEM_H
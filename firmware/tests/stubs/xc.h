@@ -0,0 +1,48 @@
+/*
+ * Copyright 2026 Esrille Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef XC_H
+#define XC_H
+
+// Only the special function registers used by the sources under test
+// outside of ENABLE_SCAN_PROFILE are declared. The ones of the SPI link to
+// the BLE module and of the power management used by HosTasks.c are
+// defined by hos_sim.c, which also defines Sleep() and Reset().
+
+extern struct { unsigned REGSLP:1, SWDTEN:1; } WDTCONbits;
+
+extern struct { unsigned LATD5:1; } LATDbits;
+extern struct { unsigned TRISD4:1, TRISD5:1; } TRISDbits;
+extern struct { unsigned TRISC6:1, TRISC7:1; } TRISCbits;
+extern volatile unsigned char TMR1L, TMR1H;
+extern volatile unsigned char SSP2BUF;
+
+extern unsigned char PMDIS0, PMDIS1, PMDIS2, PMDIS3;
+extern unsigned char T1CON;
+extern struct { unsigned GIE:1; } INTCONbits;
+extern struct { unsigned TMR1IF:1; } PIR1bits;
+extern struct { unsigned TMR1IE:1; } PIE1bits;
+extern struct { unsigned IDLEN:1; } OSCCONbits;
+
+void __delay_us(unsigned long usec);
+void _delay(unsigned long cycles);
+void Sleep(void);
+void Reset(void);
+
+#define Nop()
+#define CLRWDT()
+
+#endif  // XC_H
@@ -58,6 +58,7 @@ SUBSTITUTE GOODS, TECHNOLOGY, SERVICES, OR ANY CLAIMS BY THIRD PARTIES
 #include <stdio.h>
 #include <usb/usb.h>
 #include <usb/usb_device_hid.h>
+#include <usb/usb_hid.h>
 #include <plib/timers.h>
 
 #include "app_device_keyboard.h"
@@ -65,7 +66,18 @@ SUBSTITUTE GOODS, TECHNOLOGY, SERVICES, OR ANY CLAIMS BY THIRD PARTIES
 
 #include <Keyboard.h>
 
-#define SCAN_DELAY  (_XTAL_FREQ / 256 / 4 / 167 + 1) // About 6 [msec]
+#ifdef ENABLE_MOUSE
+#include <Mouse.h>
+#endif
+
+#ifdef ENABLE_MOUSE_HIRES
+#include "app_device_mouse.h"
+#endif
+
+#ifdef PROFILE_MAX
+#define PROFILES_REPORT_FORMAT  1
+#define PROFILES_REPORT_SIZE    (4 + PROFILE_MAX * PROFILE_SIZE)
+#endif
 
 // *****************************************************************************
 // *****************************************************************************
@@ -109,6 +121,22 @@ const struct{uint8_t report[HID_RPT01_SIZE];}hid_rpt01={
     0xc0}                          // End Collection
 };
 
+#ifdef PROFILE_MAX
+//Class specific descriptor - HID Settings profiles
+const struct{uint8_t report[HID_RPT03_SIZE];}hid_rpt03={
+{   0x06, 0x00, 0xFF,              // USAGE_PAGE (Vendor Defined Page 1)
+    0x09, 0x01,                    // USAGE (Vendor Usage 1)
+    0xa1, 0x01,                    // COLLECTION (Application)
+    0x09, 0x01,                    //   USAGE (Vendor Usage 1)
+    0x15, 0x00,                    //   LOGICAL_MINIMUM (0)
+    0x26, DESC_CONFIG_WORD(0xFF),  //   LOGICAL_MAXIMUM (255)
+    0x75, 0x08,                    //   REPORT_SIZE (8)
+    0x95, PROFILES_REPORT_SIZE,    //   REPORT_COUNT (4 + PROFILE_MAX * PROFILE_SIZE)
+    0xb1, 0x02,                    //   FEATURE (Data,Var,Abs)
+    0xc0}                          // End Collection
+};
+#endif
+
 
 // *****************************************************************************
 // *****************************************************************************
@@ -250,6 +278,22 @@ typedef union __attribute__((packed))
     } leds;
 } KEYBOARD_OUTPUT_REPORT;
 
+#ifdef PROFILE_MAX
+/* This typedef defines the vendor FEATURE report that carries the settings of
+ * all the profiles at once.  data[p][offset] is the setting stored at the
+ * EEPROM_* offset of profile p.  The host reads the report, changes it, and
+ * writes it back with SET_REPORT; the first three bytes must be kept as
+ * read.  The report is in a vendor-defined collection on an interface of its
+ * own, so that applications can open it on any OS; see tools/profiles.py. */
+typedef struct
+{
+    uint8_t format;         // PROFILES_REPORT_FORMAT
+    uint8_t profileMax;     // PROFILE_MAX
+    uint8_t profileSize;    // PROFILE_SIZE
+    uint8_t currentProfile;
+    uint8_t data[PROFILE_MAX][PROFILE_SIZE];
+} PROFILES_FEATURE_REPORT;
+#endif
 
 /* This creates a storage type for all of the information required to track the
  * current state of the keyboard. */
@@ -276,6 +320,11 @@ static KEYBOARD_INPUT_REPORT inputReport KEYBOARD_INPUT_REPORT_DATA_BUFFER_ADDRE
 #endif
 static volatile KEYBOARD_OUTPUT_REPORT outputReport KEYBOARD_OUTPUT_REPORT_DATA_BUFFER_ADDRESS_TAG;
 
+#ifdef PROFILE_MAX
+static PROFILES_FEATURE_REPORT profilesReport;
+static volatile bool profilesReceived;  // profilesReport is yet to be stored
+#endif
+
 static volatile unsigned char* rowPorts[8] = {
     &TRISA,
     &TRISA,
@@ -475,7 +524,6 @@ static unsigned char columnBits6[12] = {
 };
 #endif
 
-static int tick;
 static int8_t xmit = XMIT_NORMAL;
 
 
@@ -548,8 +596,14 @@ void APP_KeyboardInit(void)
     //Arm OUT endpoint so we can receive caps lock, num lock, etc. info from host
     keyboard.lastOUTTransmission = HIDRxPacket(HID_EP, (uint8_t*) &outputReport, sizeof(outputReport));
 
+#ifdef PROFILE_MAX
+    //The profiles interface only uses EP0; its IN endpoint is never armed, and
+    //NAKs every poll.
+    USBEnableEndpoint(HID_PROFILES_EP, USB_IN_ENABLED|USB_HANDSHAKE_ENABLED|USB_DISALLOW_SETUP);
+#endif
+
+    //Timer0 runs freely as the clock of the USB tasks.
     OpenTimer0(TIMER_INT_OFF & T0_16BIT & T0_SOURCE_INT & T0_PS_1_256);
-    tick = (int) ReadTimer0();
 }
 
 uint8_t* APP_KeyboardScan(void)
@@ -592,7 +646,7 @@ uint8_t* APP_KeyboardScan(void)
         xmit = makeReport((uint8_t*) &inputReport);
         switch (xmit) {
         case XMIT_BRK:
-            memset(&inputReport + 2, 0, 6);
+            memset(inputReport.keys, 0, 6);
             break;
         case XMIT_NORMAL:
             break;
@@ -617,15 +671,50 @@ uint8_t* APP_KeyboardScan(void)
     return (uint8_t*) &inputReport;
 }
 
-void APP_KeyboardTasks(void)
+#ifdef PROFILE_MAX
+static void APP_KeyboardGetProfiles(void)
 {
-    static int8_t cnt;
+    profilesReport.format = PROFILES_REPORT_FORMAT;
+    profilesReport.profileMax = PROFILE_MAX;
+    profilesReport.profileSize = PROFILE_SIZE;
+    profilesReport.currentProfile = CurrentProfile();
+    for (uint8_t p = 0; p < PROFILE_MAX; ++p) {
+        for (uint8_t offset = 0; offset < PROFILE_SIZE; ++offset)
+            profilesReport.data[p][offset] = ReadProfileNvram(p, offset);
+    }
+}
 
-    while (((int) ReadTimer0()) - tick < (int) SCAN_DELAY)
-        ;
-    tick = (int) ReadTimer0();
-    if (++cnt & 1)
-        return;
+/* Store the profiles received by SET_REPORT with a single flash commit, and
+ * reload the settings of the current profile. */
+static void APP_KeyboardSetProfiles(void)
+{
+    if (profilesReport.format == PROFILES_REPORT_FORMAT &&
+        profilesReport.profileMax == PROFILE_MAX &&
+        profilesReport.profileSize == PROFILE_SIZE &&
+        profilesReport.currentProfile < PROFILE_MAX)
+    {
+        for (uint8_t p = 0; p < PROFILE_MAX; ++p) {
+            for (uint8_t offset = 0; offset < PROFILE_SIZE; ++offset)
+                WriteProfileNvram(p, offset, profilesReport.data[p][offset]);
+        }
+        SelectProfile(profilesReport.currentProfile);
+        FlushNvram();
+        initKeyboard();
+#ifdef ENABLE_MOUSE
+        initMouse();
+#endif
+    }
+    profilesReceived = false;
+}
+#endif
+
+/* Run every APP_KEYBOARD_SCAN_MSEC by the scheduler in main(). */
+void APP_KeyboardTasks(void)
+{
+#ifdef PROFILE_MAX
+    if (profilesReceived)
+        APP_KeyboardSetProfiles();
+#endif
 
     /* Check if the IN endpoint is busy, and if it isn't check if we want to send
      * keystroke data to the host. */
@@ -668,8 +757,56 @@ static void USBHIDCBSetReportComplete(void)
     outputReport.value = CtrlTrfData[0];
 }
 
+#ifdef PROFILE_MAX
+static void USBHIDCBSetProfilesComplete(void)
+{
+    profilesReceived = true;
+}
+#endif
+
+void USBHIDCBGetReportHandler(void)
+{
+#ifdef ENABLE_MOUSE_HIRES
+    if (SetupPkt.bIntfID == HID_MOUSE_INTF_ID)
+    {
+        APP_DeviceMouseGetReportHandler();
+        return;
+    }
+#endif
+#ifdef PROFILE_MAX
+    if (SetupPkt.bIntfID == HID_PROFILES_INTF_ID)
+    {
+        /* The request is stalled until the profiles received are stored, so
+         * that the host reads them back as they were stored. */
+        if (SetupPkt.W_Value.byte.HB == USB_HID_REPORT_TYPE_FEATURE && !profilesReceived)
+        {
+            APP_KeyboardGetProfiles();
+            USBEP0SendRAMPtr((uint8_t*)&profilesReport, sizeof(profilesReport), USB_EP0_INCLUDE_ZERO);
+        }
+        return;
+    }
+#endif
+}
+
 void USBHIDCBSetReportHandler(void)
 {
+#ifdef ENABLE_MOUSE_HIRES
+    if (SetupPkt.bIntfID == HID_MOUSE_INTF_ID)
+    {
+        APP_DeviceMouseSetReportHandler();
+        return;
+    }
+#endif
+#ifdef PROFILE_MAX
+    if (SetupPkt.bIntfID == HID_PROFILES_INTF_ID)
+    {
+        /* The request is stalled until the previous profiles are stored. */
+        if (SetupPkt.W_Value.byte.HB == USB_HID_REPORT_TYPE_FEATURE && SetupPkt.wLength == sizeof(profilesReport) && !profilesReceived)
+            USBEP0Receive((uint8_t*)&profilesReport, sizeof(profilesReport), USBHIDCBSetProfilesComplete);
+        return;
+    }
+#endif
+
     /* Prepare to receive the keyboard LED state data through a SET_REPORT
      * control transfer on endpoint 0.  The host should only send 1 byte,
      * since this is all that the report descriptor allows it to send. */
@@ -33,6 +33,8 @@
 
 #include <stdint.h>
 
+#define APP_KEYBOARD_SCAN_MSEC  12  // Matrix scan interval [msec]
+
 void APP_KeyboardConfigure(void);
 void APP_KeyboardInit(void);
 uint8_t* APP_KeyboardScan(void);
@@ -38,6 +38,7 @@
 #include <usb/usb.h>
 #include <usb/usb_device.h>
 #include <usb/usb_device_hid.h>
+#include <usb/usb_hid.h>
 
 #include <app_led_usb_status.h>
 #include <app_device_mouse.h>
@@ -45,6 +46,10 @@
 
 #include <Mouse.h>
 
+#include <plib/timers.h>
+
+#define TIMER0_MSEC (_XTAL_FREQ / 4 / 256 / 1000)  // About Timer0 counts per msec at 1:256 prescale
+
 /*******************************************************************************
  * HID Report Descriptor - this describes the data format of the reports that
  * are sent between the host and the device.
@@ -72,6 +77,7 @@ const struct{uint8_t report[HID_RPT02_SIZE];}hid_rpt02=
         0x75, 0x03, /*      Report Size (3)                     */
         0x81, 0x01, /*      Input (Constant)    ;3 bit padding  */
         0x05, 0x01, /*      Usage Page (Generic Desktop)        */
+#ifndef ENABLE_MOUSE_HIRES
         0x09, 0x30, /*      Usage (X)                           */
         0x09, 0x31, /*      Usage (Y)                           */
         0x09, 0x38, /*      Usage (Wheel)                       */
@@ -80,6 +86,34 @@ const struct{uint8_t report[HID_RPT02_SIZE];}hid_rpt02=
         0x75, 0x08, /*      Report Size (8)                     */
         0x95, 0x03, /*      Report Count (3)                    */
         0x81, 0x06, /*      Input (Data, Variable, Relative)    */
+#else
+        0x09, 0x30, /*      Usage (X)                           */
+        0x09, 0x31, /*      Usage (Y)                           */
+        0x16, 0x01, 0x80,   /* Logical Minimum (-32767)         */
+        0x26, 0xFF, 0x7F,   /* Logical Maximum (32767)          */
+        0x75, 0x10, /*      Report Size (16)                    */
+        0x95, 0x02, /*      Report Count (2)                    */
+        0x81, 0x06, /*      Input (Data, Variable, Relative)    */
+        0xA1, 0x02, /*      Collection (Logical)                */
+        0x09, 0x48, /*          Usage (Resolution Multiplier)   */
+        0x15, 0x00, /*          Logical Minimum (0)             */
+        0x25, 0x01, /*          Logical Maximum (1)             */
+        0x35, 0x01, /*          Physical Minimum (1)            */
+        0x45, 0x08, /*          Physical Maximum (8)            */
+        0x75, 0x02, /*          Report Size (2)                 */
+        0x95, 0x01, /*          Report Count (1)                */
+        0xB1, 0x02, /*          Feature (Data, Variable, Absolute) */
+        0x35, 0x00, /*          Physical Minimum (0)            */
+        0x45, 0x00, /*          Physical Maximum (0)            */
+        0x09, 0x38, /*          Usage (Wheel)                   */
+        0x15, 0x81, /*          Logical Minimum (-127)          */
+        0x25, 0x7F, /*          Logical Maximum (127)           */
+        0x75, 0x08, /*          Report Size (8)                 */
+        0x81, 0x06, /*          Input (Data, Variable, Relative) */
+        0xC0,       /*      End Collection                      */
+        0x75, 0x06, /*      Report Size (6)                     */
+        0xB1, 0x01, /*      Feature (Constant)  ;6 bit padding  */
+#endif
         0xC0, 0xC0  /* End Collection,End Collection            */
     }
 };
@@ -166,6 +200,28 @@ typedef struct __attribute__((packed))
     int8_t wheel;
 } MOUSE_REPORT;
 
+#ifdef ENABLE_MOUSE_HIRES
+/* INPUT report in the report protocol with ENABLE_MOUSE_HIRES.  MOUSE_REPORT
+ * is still used in the boot protocol.  The wheel is in 1/8 detents while the
+ * Resolution Multiplier FEATURE report is set to 1, and in detents otherwise.
+ */
+typedef struct __attribute__((packed))
+{
+    uint8_t buttons;
+    int16_t x;
+    int16_t y;
+    int8_t wheel;
+} MOUSE_HIRES_REPORT;
+#endif
+
+typedef union
+{
+    MOUSE_REPORT boot;
+#ifdef ENABLE_MOUSE_HIRES
+    MOUSE_HIRES_REPORT hires;
+#endif
+} MOUSE_REPORT_BUFFER;
+
 /** VARIABLES ******************************************************/
 /* Some processors have a limited range of RAM addresses where the USB module
  * is able to access.  The following section is for those devices.  This section
@@ -175,18 +231,23 @@ typedef struct __attribute__((packed))
 #if defined(FIXED_ADDRESS_MEMORY)
     #if defined(COMPILER_MPLAB_C18)
         #pragma udata MOUSE_REPORT_DATA_BUFFER=MOUSE_REPORT_DATA_BUFFER_ADDRESS
-            static MOUSE_REPORT mouseReport;
+            static MOUSE_REPORT_BUFFER mouseReport;
         #pragma udata
     #elif defined(__XC8)
-        static MOUSE_REPORT mouseReport @ MOUSE_REPORT_DATA_BUFFER_ADDRESS;
+        static MOUSE_REPORT_BUFFER mouseReport @ MOUSE_REPORT_DATA_BUFFER_ADDRESS;
     #endif
 #else
-    static MOUSE_REPORT mouseReport;
+    static MOUSE_REPORT_BUFFER mouseReport;
 #endif
 
 typedef struct
 {
     USB_HANDLE lastINTransmission;
+    int tick;               // Timer0 count the report clock of Mouse.c is at
+#ifdef ENABLE_MOUSE_HIRES
+    uint8_t protocol;       // BOOT_PROTOCOL or RPT_PROTOCOL
+    uint8_t resolution;     // Resolution Multiplier FEATURE report
+#endif
 } MOUSE;
 
 static MOUSE mouse;
@@ -225,11 +286,69 @@ void APP_DeviceMouseInitialize(void)
 
     /* initialize the handles to invalid so we know they aren't being used. */
     mouse.lastINTransmission = NULL;
+    mouse.tick = (int) ReadTimer0();
+
+#ifdef ENABLE_MOUSE_HIRES
+    /* The report protocol is selected after a reset, and the wheel is in
+     * detents until the host sets the Resolution Multiplier. */
+    mouse.protocol = RPT_PROTOCOL;
+    mouse.resolution = 0;
+    setMouseWheelResolution(0);
+#endif
 
     //enable the HID endpoint
     USBEnableEndpoint(HID_MOUSE_EP,USB_IN_ENABLED|USB_HANDSHAKE_ENABLED|USB_DISALLOW_SETUP);
 }//end UserInit
 
+#ifdef ENABLE_MOUSE_HIRES
+static void APP_DeviceMouseHiresTasks(void)
+{
+    MOUSE_HIRES_REPORT* report = &mouseReport.hires;
+
+    if(HIDTxHandleBusy(mouse.lastINTransmission) == false)
+    {
+        report->buttons = getKeyboardMouseButtons();
+        report->x = getKeyboardMouseX16();
+        report->y = getKeyboardMouseY16();
+        report->wheel = getKeyboardMouseWheel();
+        mouse.lastINTransmission = HIDTxPacket(HID_MOUSE_EP, (uint8_t*) report, sizeof(MOUSE_HIRES_REPORT));
+        sentKeyboardMouse(report->x, report->y, report->wheel);
+    }
+}
+
+static void APP_DeviceMouseUpdateResolution(void)
+{
+    setMouseWheelResolution(mouse.protocol == RPT_PROTOCOL && (mouse.resolution & 0x03));
+}
+
+/* Keep track of SET_PROTOCOL requests to the mouse interface.  The request
+ * itself is answered by USBCheckHIDRequest().
+ */
+void APP_DeviceMouseCheckRequest(void)
+{
+    if (SetupPkt.Recipient == USB_SETUP_RECIPIENT_INTERFACE_BITFIELD &&
+        SetupPkt.RequestType == USB_SETUP_TYPE_CLASS_BITFIELD &&
+        SetupPkt.bIntfID == HID_MOUSE_INTF_ID &&
+        SetupPkt.bRequest == SET_PROTOCOL)
+    {
+        mouse.protocol = SetupPkt.W_Value.byte.LB;
+        APP_DeviceMouseUpdateResolution();
+    }
+}
+
+void APP_DeviceMouseGetReportHandler(void)
+{
+    if (SetupPkt.W_Value.byte.HB == USB_HID_REPORT_TYPE_FEATURE)
+        USBEP0SendRAMPtr(&mouse.resolution, sizeof mouse.resolution, USB_EP0_INCLUDE_ZERO);
+}
+
+void APP_DeviceMouseSetReportHandler(void)
+{
+    if (SetupPkt.W_Value.byte.HB == USB_HID_REPORT_TYPE_FEATURE && SetupPkt.wLength == sizeof mouse.resolution)
+        USBEP0Receive(&mouse.resolution, sizeof mouse.resolution, APP_DeviceMouseUpdateResolution);
+}
+#endif
+
 /*********************************************************************
 * Function: void APP_DeviceMouseTasks(void);
 *
@@ -246,25 +365,52 @@ void APP_DeviceMouseInitialize(void)
 ********************************************************************/
 void APP_DeviceMouseTasks(void)
 {
-    /* Do not report unchanged state.
+    uint8_t msec = 0;
+
+#ifdef ENABLE_MOUSE_HIRES
+    /* Keep no more motion than the report of the current protocol can
+     * carry.  mouse.protocol is set by the USB interrupt handler, so this
+     * is checked here rather than there.
      */
-    if (mouseReport.buttons.value == getKeyboardMouseButtons() &&
-        mouseReport.x == 0 && mouseReport.x == getKeyboardMouseX() &&
-        mouseReport.y == 0 && mouseReport.y == getKeyboardMouseY() &&
-        mouseReport.wheel == 0 && mouseReport.wheel == getKeyboardMouseWheel())
+    setMouseMotionLimit(mouse.protocol == RPT_PROTOCOL ? MOUSE_HIRES_MOTION_MAX : MOUSE_MOTION_MAX);
+#endif
+
+    /* Parse the TSAP frames queued by the UART interrupt handler.
+     */
+    processSerialQueue();
+
+    /* Report only when Mouse.c says a report is due; motion and scroll are
+     * coalesced until the report interval has passed.
+     */
+    while ((int) TIMER0_MSEC <= ((int) ReadTimer0()) - mouse.tick && msec < 0xff)
+    {
+        mouse.tick += TIMER0_MSEC;
+        ++msec;
+    }
+    tickMouseReport(msec);
+    if (!isMouseReportDue())
+    {
+        return;
+    }
+
+#ifdef ENABLE_MOUSE_HIRES
+    if (mouse.protocol == RPT_PROTOCOL)
     {
+        APP_DeviceMouseHiresTasks();
         return;
     }
+#endif
 
     /* We can only send a report if the last report has been sent.
      */
     if(HIDTxHandleBusy(mouse.lastINTransmission) == false)
     {
-        mouseReport.buttons.value = getKeyboardMouseButtons();
-        mouseReport.x = getKeyboardMouseX();
-        mouseReport.y = getKeyboardMouseY();
-        mouseReport.wheel = getKeyboardMouseWheel();
-        mouse.lastINTransmission = HIDTxPacket(HID_MOUSE_EP, (uint8_t*) &mouseReport, sizeof mouseReport);
+        mouseReport.boot.buttons.value = getKeyboardMouseButtons();
+        mouseReport.boot.x = getKeyboardMouseX();
+        mouseReport.boot.y = getKeyboardMouseY();
+        mouseReport.boot.wheel = getKeyboardMouseWheel();
+        mouse.lastINTransmission = HIDTxPacket(HID_MOUSE_EP, (uint8_t*) &mouseReport.boot, sizeof mouseReport.boot);
+        sentKeyboardMouse((int8_t) mouseReport.boot.x, (int8_t) mouseReport.boot.y, mouseReport.boot.wheel);
     }
 }//end ProcessIO
 
@@ -58,4 +58,38 @@ void APP_DeviceMouseInitialize();
 ********************************************************************/
 void APP_DeviceMouseTasks();
 
+#ifdef ENABLE_MOUSE_HIRES
+/*********************************************************************
+* Function: void APP_DeviceMouseCheckRequest(void);
+*
+* Overview: Keeps track of the protocol selected by the host.  Call it
+*   from the EVENT_EP0_REQUEST handler.
+*
+* PreCondition: None
+*
+* Input: None
+*
+* Output: None
+*
+********************************************************************/
+void APP_DeviceMouseCheckRequest(void);
+
+/*********************************************************************
+* Function: void APP_DeviceMouseGetReportHandler(void);
+*          void APP_DeviceMouseSetReportHandler(void);
+*
+* Overview: Handle GET_REPORT and SET_REPORT requests to the mouse
+*   interface for the Resolution Multiplier FEATURE report.
+*
+* PreCondition: None
+*
+* Input: None
+*
+* Output: None
+*
+********************************************************************/
+void APP_DeviceMouseGetReportHandler(void);
+void APP_DeviceMouseSetReportHandler(void);
+#endif
+
 #endif
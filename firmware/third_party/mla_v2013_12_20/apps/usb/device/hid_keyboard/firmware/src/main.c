@@ -65,17 +65,21 @@ SUBSTITUTE GOODS, TECHNOLOGY, SERVICES, OR ANY CLAIMS BY THIRD PARTIES
 
 #include <usb/usb.h>
 #include <usb/usb_device_hid.h>
+#include <plib/timers.h>
 
 #include "app_led_usb_status.h"
 #include "app_device_keyboard.h"
 #include "app_device_mouse.h"
 
 #include <Keyboard.h>
+#include <Scheduler.h>
 
 #ifdef ENABLE_MOUSE
 #include <Mouse.h>
 #endif
 
+#define TIMER0_MSEC (_XTAL_FREQ / 4 / 256 / 1000)  // About Timer0 counts per msec at 1:256 prescale
+
 
 // *****************************************************************************
 // *****************************************************************************
@@ -84,6 +88,19 @@ SUBSTITUTE GOODS, TECHNOLOGY, SERVICES, OR ANY CLAIMS BY THIRD PARTIES
 // *****************************************************************************
 static void USBCBSendResume(void);
 
+/* The tasks run while the USB device is configured, with a tick of 1 msec.
+ * The mouse tasks run every tick so that TSAP frames are not held up by the
+ * keyboard scan interval. */
+static Task tasks[] = {
+#ifdef ENABLE_MOUSE
+    TASK(APP_DeviceMouseTasks, 1, 1),
+#endif
+    TASK(APP_KeyboardTasks, APP_KEYBOARD_SCAN_MSEC, 1),
+    TASK(PollNvram, APP_KEYBOARD_SCAN_MSEC, APP_KEYBOARD_SCAN_MSEC),
+};
+
+#define TASK_COUNT  (sizeof tasks / sizeof tasks[0])
+
 // *****************************************************************************
 // *****************************************************************************
 // Section: File Scope Data Types
@@ -97,6 +114,31 @@ static void USBCBSendResume(void);
 // *****************************************************************************
 // *****************************************************************************
 
+/* Return the ticks elapsed since the last call as counted by Timer0, which
+ * APP_KeyboardInit() starts. */
+static uint8_t APP_TicksElapsed(void)
+{
+    static int last;
+    uint8_t ticks = 0;
+
+    while ((int) TIMER0_MSEC <= ((int) ReadTimer0()) - last && ticks < 0xff)
+    {
+        last += TIMER0_MSEC;
+        ++ticks;
+    }
+    return ticks;
+}
+
+/* Wait in Idle mode for the next interrupt. While the bus is active, the
+ * start-of-frame interrupt comes every 1 msec, i.e. every tick. */
+static void APP_Idle(void)
+{
+    OSCCONbits.IDLEN = 1;
+    Sleep();
+    Nop();
+    OSCCONbits.IDLEN = 0;
+}
+
 int main(void)
 {
     SYSTEM_Initialize(SYSTEM_STATE_USB_START);
@@ -104,12 +146,12 @@ int main(void)
     APP_KeyboardConfigure();
 
 #ifdef WITH_HOS
-    HosCheckDFU(BOOT_FLAGS_VALUE & BOOT_WITH_APP);
+    bool dfu = BOOT_FLAGS_VALUE & BOOT_WITH_APP;
     if (!isUSBMode() || !isBusPowered()) {
-        HosMainLoop();
+        HosRunTasks(dfu);
     }
     for (uint16_t i = 0; i < HOS_STARTUP_DELAY; ++i) {
-        if (HosSleep(HOS_TYPE_DEFAULT)) {
+        if (dfu ? HosSetEvent(HOS_TYPE_INFO, HOS_EVENT_DFU) : HosSleep(HOS_TYPE_DEFAULT)) {
             break;
         }
         __delay_ms(4);
@@ -119,10 +161,13 @@ int main(void)
     USBDeviceInit();
     USBDeviceAttach();
 
+    initTasks(tasks, TASK_COUNT);
+
     for (;;)
     {
 #ifdef WITH_HOS
         if (!isBusPowered() || !isUSBMode()) {
+            FlushNvram();
             Reset();
             Nop();
             Nop();
@@ -171,6 +216,9 @@ int main(void)
                 USBCBSendResume();  //Does nothing unless we are in USB suspend with remote wakeup armed.
             }
 
+            //Save the settings changed before the suspend.
+            FlushNvram();
+
             /* Jump back to the top of the while loop. */
             continue;
         }
@@ -181,8 +229,12 @@ int main(void)
             continue;
         }
 
-        /* Run the keyboard tasks. */
-        APP_KeyboardTasks();
+        /* Run the tasks that are due, and sleep until the next tick unless
+         * a task is to run now. */
+        if (runTasks(tasks, TASK_COUNT, APP_TicksElapsed()))
+        {
+            APP_Idle();
+        }
     }//end while
 }//end main
 
@@ -349,6 +401,9 @@ bool USER_USB_CALLBACK_EVENT_HANDLER(USB_EVENT event, void *pdata, uint16_t size
             /* We have received a non-standard USB request.  The HID driver
              * needs to check to see if the request was for it. */
             USBCheckHIDRequest();
+#ifdef ENABLE_MOUSE_HIRES
+            APP_DeviceMouseCheckRequest();
+#endif
             break;
 
         case EVENT_BUS_ERROR:
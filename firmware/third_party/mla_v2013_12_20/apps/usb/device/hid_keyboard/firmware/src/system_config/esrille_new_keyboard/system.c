@@ -207,6 +207,7 @@ void interrupt SYS_InterruptHigh(void)
             ReadUSART();    // Clear FERR
             RCSTA = 0;      // Clear OERR
             RCSTA = 0x90;   // Restart USARTs
+            serialLost();
         } else {
             uint8_t data = ReadUSART();    // Clear FERR
 
@@ -214,9 +215,10 @@ void interrupt SYS_InterruptHigh(void)
              * packet that will configure this device, thus, we need to make sure that
              * we are actually initialized and open before we do anything else,
              * otherwise we should exit the function without doing anything.
+             * The frames are parsed by APP_DeviceMouseTasks() in the main loop.
              */
-            if (USBGetDeviceState() == CONFIGURED_STATE && processSerialUnit(data)) {
-                APP_DeviceMouseTasks();
+            if (USBGetDeviceState() == CONFIGURED_STATE) {
+                queueSerialData(data);
             }
         }
     }
@@ -280,15 +280,17 @@ void interrupt SYS_InterruptHigh(void)
             Read2USART();   // Clear FERR
             RCSTA2 = 0;     // Clear OERR
             RCSTA2 = 0x90;  // Restart USARTs
+            serialLost();
         } else {
             uint8_t data = Read2USART();    // Clear FERR
             /* We will be getting data before we get the SET_CONFIGURATION
              * packet that will configure this device, thus, we need to make sure that
              * we are actually initialized and open before we do anything else,
              * otherwise we should exit the function without doing anything.
+             * The frames are parsed by APP_DeviceMouseTasks() in the main loop.
              */
-            if (USBGetDeviceState() == CONFIGURED_STATE && processSerialUnit(data)) {
-                APP_DeviceMouseTasks();
+            if (USBGetDeviceState() == CONFIGURED_STATE) {
+                queueSerialData(data);
             }
         }
     }
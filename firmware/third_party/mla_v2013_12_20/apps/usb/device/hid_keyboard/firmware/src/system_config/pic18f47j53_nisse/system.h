@@ -41,6 +41,7 @@
 
 #ifdef WITH_HOS
 #include <HosMaster.h>
+#include <HosTasks.h>
 #endif
 
 #include <io_mapping.h>
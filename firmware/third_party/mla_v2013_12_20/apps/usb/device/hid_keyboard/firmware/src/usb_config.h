@@ -36,6 +36,7 @@
 #define USBCFG_H
 
 #include "usb/usb_ch9.h"
+#include <nvram.h>  // PROFILE_MAX
 
 /** DEFINITIONS ****************************************************/
 #define USB_EP0_BUFF_SIZE       8   // Valid Options: 8, 16, 32, or 64 bytes.
@@ -46,11 +47,21 @@
                                     // application related data.
 
 #ifndef ENABLE_MOUSE
+#ifndef PROFILE_MAX
 #define USB_MAX_NUM_INT     	1
 #define USB_MAX_EP_NUMBER       1
 #else
+#define USB_MAX_NUM_INT     	2
+#define USB_MAX_EP_NUMBER       2
+#endif
+#else
+#ifndef PROFILE_MAX
 #define USB_MAX_NUM_INT     	2   //Set this number to match the maximum interface number used in the descriptors for this firmware project
 #define USB_MAX_EP_NUMBER	    2   //Set this number to match the maximum endpoint number used in the descriptors for this firmware project
+#else
+#define USB_MAX_NUM_INT     	3
+#define USB_MAX_EP_NUMBER	    3
+#endif
 #endif
 
 //Make sure only one of the below "#define USB_PING_PONG_MODE"
@@ -138,24 +149,43 @@
 #define HID_INT_OUT_EP_SIZE         1
 #define HID_INT_IN_EP_SIZE          8
 #define HID_RPT01_SIZE              64
-//#define USER_GET_REPORT_HANDLER USBHIDCBGetReportHandler
+#define USER_GET_REPORT_HANDLER USBHIDCBGetReportHandler
 #define USER_SET_REPORT_HANDLER USBHIDCBSetReportHandler
 
 /* HID - Mouse */
 #define HID_MOUSE_INTF_ID           0x01
 #define HID_MOUSE_EP                2
 #define HID_MOUSE_INT_OUT_EP_SIZE   3
-#define HID_MOUSE_INT_IN_EP_SIZE    3
+#ifndef ENABLE_MOUSE_HIRES
+#define HID_MOUSE_INT_IN_EP_SIZE    4
 #define HID_RPT02_SIZE              52
+#else
+#define HID_MOUSE_INT_IN_EP_SIZE    6
+#define HID_RPT02_SIZE              89  // With 16-bit X/Y and the Resolution Multiplier
+#endif
 
-#define HID_NUM_OF_DSC              1
-
+/* HID - Settings profiles
+ * A vendor-defined collection of its own, which the OS does not claim for
+ * itself, carries the profiles feature report.  HID requires an interrupt
+ * IN endpoint, which never sends anything. */
+#ifdef PROFILE_MAX
 #ifndef ENABLE_MOUSE
-#define HID_NUM_OF_INTF             1
+#define HID_PROFILES_INTF_ID        0x01
+#define HID_PROFILES_EP             2
+#define HID_PROFILES_DSC_OFFSET     50  // Of the HID descriptor in configDescriptor1
 #else
-#define HID_NUM_OF_INTF             2
+#define HID_PROFILES_INTF_ID        0x02
+#define HID_PROFILES_EP             3
+#define HID_PROFILES_DSC_OFFSET     75
+#endif
+#define HID_PROFILES_INT_IN_EP_SIZE 1
+#define HID_RPT03_SIZE              21
 #endif
 
+#define HID_NUM_OF_DSC              1
+
+#define HID_NUM_OF_INTF             USB_MAX_NUM_INT
+
 /** DEFINITIONS ****************************************************/
 
 #endif //USBCFG_H
@@ -92,12 +92,15 @@ const uint8_t configDescriptor1[]={
     /* Configuration Descriptor */
     0x09,//sizeof(USB_CFG_DSC),    // Size of this descriptor in bytes
     USB_DESCRIPTOR_CONFIGURATION,                // CONFIGURATION descriptor type
-#ifndef ENABLE_MOUSE
+#if !defined(ENABLE_MOUSE) && !defined(PROFILE_MAX)
     DESC_CONFIG_WORD(0x29), // Total length of data for this cfg
     1,                      // Number of interfaces in this cfg
-#else
+#elif !defined(ENABLE_MOUSE) || !defined(PROFILE_MAX)
     DESC_CONFIG_WORD(0x42), // Total length of data for this cfg
     2,                      // Number of interfaces in this cfg
+#else
+    DESC_CONFIG_WORD(0x5B), // Total length of data for this cfg
+    3,                      // Number of interfaces in this cfg
 #endif
     1,                      // Index value of this configuration
     0,                      // Configuration string index
@@ -166,8 +169,38 @@ const uint8_t configDescriptor1[]={
     USB_DESCRIPTOR_ENDPOINT,    //Endpoint Descriptor
     HID_MOUSE_EP | _EP_IN,            //EndpointAddress
     _INTERRUPT,                       //Attributes
-    DESC_CONFIG_WORD(4),                  //size
-    0x01                        //Interval
+    DESC_CONFIG_WORD(HID_MOUSE_INT_IN_EP_SIZE),   //size
+    0x01,                       //Interval
+#endif
+
+#ifdef PROFILE_MAX
+    /* Interface Descriptor */
+    0x09,//sizeof(USB_INTF_DSC),   // Size of this descriptor in bytes
+    USB_DESCRIPTOR_INTERFACE,               // INTERFACE descriptor type
+    HID_PROFILES_INTF_ID,   // Interface Number
+    0,                      // Alternate Setting Number
+    1,                      // Number of endpoints in this intf
+    HID_INTF,               // Class code
+    0,                      // Subclass code (no boot interface)
+    0,                      // Protocol code
+    0,                      // Interface string index
+
+    /* HID Class-Specific Descriptor */
+    0x09,//sizeof(USB_HID_DSC)+3,    // Size of this descriptor in bytes RRoj hack
+    DSC_HID,                // HID descriptor type
+    DESC_CONFIG_WORD(0x0111),                 // HID Spec Release Number in BCD format (1.11)
+    0x00,                   // Country Code (0x00 for Not supported)
+    HID_NUM_OF_DSC,         // Number of class descriptors, see usbcfg.h
+    DSC_RPT,                // Report descriptor type
+    DESC_CONFIG_WORD(HID_RPT03_SIZE),   // Size of the report descriptor
+
+    /* Endpoint Descriptor */
+    0x07,/*sizeof(USB_EP_DSC)*/
+    USB_DESCRIPTOR_ENDPOINT,    //Endpoint Descriptor
+    HID_PROFILES_EP | _EP_IN,   //EndpointAddress
+    _INTERRUPT,                       //Attributes
+    DESC_CONFIG_WORD(HID_PROFILES_INT_IN_EP_SIZE),   //size
+    0xFF                        //Interval; never sends anything
 #endif
 };
 
@@ -22,5 +22,7 @@
 #define InitNvram()
 #define ReadNvram(offset)           eeprom_read(offset)
 #define WriteNvram(offset, value)   eeprom_write(offset, value)
+#define PollNvram()
+#define FlushNvram()
 
 #endif //NVRAM_H
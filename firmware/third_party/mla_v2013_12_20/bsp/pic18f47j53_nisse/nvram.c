@@ -20,13 +20,42 @@
 #include <string.h>
 #include <plib/flash.h>
 
+//
+// The NVRAM region is a log. The first block holds a snapshot of the
+// Profiles structure, and each change after it is appended as a 4-byte
+// record {index, value, seq, check} that sets the byte at 'index' of the
+// snapshot. The region is erased and a new snapshot is written only when
+// the log runs out of room. Each new snapshot increments seq, and the
+// records carry the seq of their snapshot.
+//
+// The snapshot and the records are both checked with a CRC-8, so that a
+// write cut short by a power loss is ignored. Records are only appended,
+// so the end of the log is found by a binary search for the first erased
+// slot.
+//
+// Changes are made to the shadow right away and written later by
+// PollNvram(), once no setting has changed for NVRAM_COMMIT_DELAY calls,
+// so that a burst of changes to the same setting costs a single record.
+// FlushNvram() writes them at once, and must be called before Reset() or
+// a suspend.
+//
+
 #define NVRAM_ADDRESS   0x1F800
 #define NVRAM_SIZE      1024
 #define NVRAM_BLOCK     64
 #define NVRAM_MAX       (NVRAM_SIZE / NVRAM_BLOCK)
 
-#define PROFILE_SIZE    10
-#define PROFILE_MAX     4
+#define NVRAM_LOG       NVRAM_BLOCK     // Offset of the first record
+#define RECORD_SIZE     4               // {index, value, seq, check}; written as two words
+#define RECORD_MAX      ((NVRAM_SIZE - NVRAM_LOG) / RECORD_SIZE)
+#define RECORD_ERASED   0xff            // Index of an unwritten record
+
+#define NVRAM_COMMIT_DELAY  64  // [PollNvram() call] Time without changes before they are written
+
+#define LEGACY_PROFILE_SIZE 10  // Profile size of the blocks signed 0x01
+
+#define SIG_LEGACY      0x01
+#define SIG_LOG         0x04
 
 typedef struct Profile {
     uint8_t data[PROFILE_SIZE];
@@ -34,54 +63,181 @@ typedef struct Profile {
 
 typedef struct Profiles {
     Profile profiles[PROFILE_MAX];
-    uint8_t reserved[NVRAM_BLOCK - (PROFILE_SIZE * PROFILE_MAX + 2)];
+    uint8_t global[GLOBAL_SIZE];    // Shared by all profiles; zero in the blocks before the log
+    uint8_t seq;    // Snapshot number
+    uint8_t check;  // CRC-8 of the block with check set to zero
     uint8_t current_profile;
-    uint8_t sig;    // 0x01: flashed, 0xff: erased
+    uint8_t sig;    // 0x04: log snapshot, 0x01: block copy, 0xff: erased
 } Profiles;
 
+#ifdef __XC8
 static const uint8_t nvramArray[NVRAM_SIZE] @ NVRAM_ADDRESS;    // Note __at() seems not working here with xc8 v1.34
-static int8_t current = -1;
+#else
+extern const uint8_t nvramArray[NVRAM_SIZE];    // Simulated by firmware/tests/nvram_test.c
+#endif
+static uint16_t tail = NVRAM_SIZE;  // Offset of the next record
 static Profiles shadow;
+static uint8_t dirty[NVRAM_BLOCK / 8];  // Shadow bytes yet to be written
+static uint8_t pending;                 // PollNvram() calls left until the changes are written
 
-static void PutNvram(void)
+static uint8_t Crc8(uint8_t crc, uint8_t data)
 {
-    uint8_t swdten = WDTCONbits.SWDTEN;
-    if (swdten) {
-        // Disable watchdog timer while modifying the flash block.
-        CLRWDT();
-        WDTCONbits.SWDTEN = 0;
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; ++i)
+        crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+    return crc;
+}
+
+static uint8_t CheckShadow(void)
+{
+    uint8_t check = shadow.check;
+    uint8_t crc = 0;
+
+    shadow.check = 0;
+    for (uint8_t i = 0; i < NVRAM_BLOCK; ++i)
+        crc = Crc8(crc, ((uint8_t*) &shadow)[i]);
+    shadow.check = check;
+    return crc;
+}
+
+static uint8_t CheckRecord(uint8_t index, uint8_t value, uint8_t seq)
+{
+    return Crc8(Crc8(Crc8(0, index), value), seq);
+}
+
+// Erase the region and start a new log with the shadow as its snapshot.
+static void Compact(void)
+{
+    shadow.sig = SIG_LOG;
+    ++shadow.seq;
+    shadow.check = CheckShadow();
+    EraseFlash(NVRAM_ADDRESS, NVRAM_ADDRESS + NVRAM_SIZE);
+    WriteBlockFlash(NVRAM_ADDRESS, 1, (void*) &shadow);
+    tail = NVRAM_LOG;
+}
+
+// Return the offset of the first erased record slot.
+static uint16_t FindTail(void)
+{
+    uint16_t low = 0;
+    uint16_t high = RECORD_MAX;
+
+    while (low < high) {
+        uint16_t mid = (low + high) / 2;
+        if (nvramArray[NVRAM_LOG + RECORD_SIZE * mid] == RECORD_ERASED)
+            high = mid;
+        else
+            low = mid + 1;
     }
+    // Skip a slot left half written by a power loss.
+    uint16_t offset = NVRAM_LOG + RECORD_SIZE * low;
+    if (offset < NVRAM_SIZE &&
+        (nvramArray[offset + 1] & nvramArray[offset + 2] & nvramArray[offset + 3]) != 0xff)
+        offset += RECORD_SIZE;
+    return offset;
+}
+
+// Write a record for each shadow byte changed since the last flush.
+void FlushNvram(void)
+{
+    uint8_t swdten = WDTCONbits.SWDTEN;
 
-    shadow.sig = 0x01;
-    if (NVRAM_MAX <= ++current) {
-        EraseFlash(NVRAM_ADDRESS, NVRAM_ADDRESS + NVRAM_SIZE);
-        current = 0;
+    pending = 0;
+    for (uint8_t index = 0; index < NVRAM_BLOCK; ++index) {
+        uint8_t bit = 1u << (index & 7);
+        if (!(dirty[index / 8] & bit))
+            continue;
+        dirty[index / 8] &= ~bit;
+        if (WDTCONbits.SWDTEN) {
+            // Disable watchdog timer while modifying the flash block.
+            CLRWDT();
+            WDTCONbits.SWDTEN = 0;
+        }
+        if (NVRAM_SIZE <= tail) {
+            Compact();  // The snapshot includes every change.
+            memset(dirty, 0, sizeof dirty);
+            break;
+        }
+        uint8_t value = ((uint8_t*) &shadow)[index];
+        WriteWordFlash(NVRAM_ADDRESS + tail, index | ((uint16_t) value << 8));
+        WriteWordFlash(NVRAM_ADDRESS + tail + 2, shadow.seq | ((uint16_t) CheckRecord(index, value, shadow.seq) << 8));
+        tail += RECORD_SIZE;
     }
-    WriteBlockFlash(NVRAM_ADDRESS + NVRAM_BLOCK * current, 1, (void*) &shadow);
 
     WDTCONbits.SWDTEN = swdten;
 }
 
-void InitNvram(void)
+// Called once per scan while the keyboard runs.
+void PollNvram(void)
+{
+    if (pending && !--pending)
+        FlushNvram();
+}
+
+static void SetNvram(uint8_t* p, uint8_t value)
 {
-    current = -1;
+    if (*p != value) {
+        uint8_t index = p - (uint8_t*) &shadow;
+        *p = value;
+        dirty[index / 8] |= 1u << (index & 7);
+        pending = NVRAM_COMMIT_DELAY;
+    }
+}
+
+// Load the newest block written by the firmware before the log was
+// introduced.
+static int8_t LoadBlocks(void)
+{
+    int8_t current = -1;
+
     for (int8_t i = 0; i < NVRAM_MAX; ++i) {
         ReadFlash(NVRAM_ADDRESS + NVRAM_BLOCK * i, NVRAM_BLOCK, (void*) &shadow);
-        if (shadow.sig == 0x01 && shadow.current_profile < PROFILE_MAX) {
+        if (shadow.sig == SIG_LEGACY && shadow.current_profile < PROFILE_MAX) {
             current = i;
             continue;
         }
         break;
     }
-    if (current == -1) {
-        current = NVRAM_MAX - 1;
+    if (current == -1)
+        return 0;
+    ReadFlash(NVRAM_ADDRESS + NVRAM_BLOCK * current, NVRAM_BLOCK, (void*) &shadow);
+    // Spread the profiles out to the current size, the last one first.
+    for (int8_t i = PROFILE_MAX - 1; 0 <= i; --i) {
+        memmove(shadow.profiles[i].data, (uint8_t*) &shadow + LEGACY_PROFILE_SIZE * i, LEGACY_PROFILE_SIZE);
+        memset(shadow.profiles[i].data + LEGACY_PROFILE_SIZE, 0, PROFILE_SIZE - LEGACY_PROFILE_SIZE);
+    }
+    return 1;
+}
+
+void InitNvram(void)
+{
+    ReadFlash(NVRAM_ADDRESS, NVRAM_BLOCK, (void*) &shadow);
+    if (shadow.sig == SIG_LOG && CheckShadow() == shadow.check) {
+        uint8_t seq = shadow.seq;
+        tail = FindTail();
+        for (uint16_t offset = NVRAM_LOG; offset < tail; offset += RECORD_SIZE) {
+            uint8_t index = nvramArray[offset];
+            uint8_t value = nvramArray[offset + 1];
+            if (index < NVRAM_BLOCK - 1 &&  // Never the sig
+                nvramArray[offset + 2] == seq &&
+                nvramArray[offset + 3] == CheckRecord(index, value, seq))
+                ((uint8_t*) &shadow)[index] = value;
+        }
+        shadow.seq = seq;
+        if (shadow.current_profile < PROFILE_MAX)
+            return;
+    }
+
+    // Start a new log at the first write.
+    tail = NVRAM_SIZE;
+    if (!LoadBlocks()) {
         shadow.current_profile = 0;
         for (int8_t i = 0; i < PROFILE_MAX; ++i) {
             memcpy(shadow.profiles[i].data, nvram_initial_data, NVRAM_INITIAL_DATA_SIZE);
             memset(shadow.profiles[i].data + NVRAM_INITIAL_DATA_SIZE, 0, PROFILE_SIZE - NVRAM_INITIAL_DATA_SIZE);
         }
-    } else
-        ReadFlash(NVRAM_ADDRESS + NVRAM_BLOCK * current, NVRAM_BLOCK, (void*) &shadow);
+    }
+    memset(shadow.global, 0, GLOBAL_SIZE);  // Erased or unused before the log
 }
 
 uint8_t ReadNvram(uint8_t offset)
@@ -91,17 +247,35 @@ uint8_t ReadNvram(uint8_t offset)
 
 void WriteNvram(uint8_t offset, uint8_t value)
 {
-    shadow.profiles[shadow.current_profile].data[offset] = value;
-    PutNvram();
+    SetNvram(&shadow.profiles[shadow.current_profile].data[offset], value);
 }
 
 void SelectProfile(uint8_t profile)
 {
-    shadow.current_profile = profile;
-    PutNvram();
+    SetNvram(&shadow.current_profile, profile);
 }
 
 uint8_t CurrentProfile(void)
 {
     return shadow.current_profile;
 }
+
+uint8_t ReadProfileNvram(uint8_t profile, uint8_t offset)
+{
+    return shadow.profiles[profile].data[offset];
+}
+
+void WriteProfileNvram(uint8_t profile, uint8_t offset, uint8_t value)
+{
+    SetNvram(&shadow.profiles[profile].data[offset], value);
+}
+
+uint8_t ReadGlobalNvram(uint8_t offset)
+{
+    return shadow.global[offset];
+}
+
+void WriteGlobalNvram(uint8_t offset, uint8_t value)
+{
+    SetNvram(&shadow.global[offset], value);
+}
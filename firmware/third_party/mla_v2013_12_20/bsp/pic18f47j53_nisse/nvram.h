@@ -21,16 +21,28 @@
 
 #define NVRAM_INITIAL_DATA_SIZE 8
 
+#define PROFILE_SIZE    12      // Covers the EEPROM_* offsets in Keyboard.h
+#define PROFILE_MAX     4
+#define GLOBAL_SIZE     12      // Covers the NVRAM_GLOBAL_* offsets in Keyboard.h
+
 #define NVRAM_DATA(a, b, c, d, e, f, g, h)  \
     const uint8_t nvram_initial_data[NVRAM_INITIAL_DATA_SIZE] = { a, b, c, d, e, f, g, h }
 
 void InitNvram(void);
 uint8_t ReadNvram(uint8_t offset);
 void WriteNvram(uint8_t offset, uint8_t value);
+void PollNvram(void);
+void FlushNvram(void);
 
 void SelectProfile(uint8_t profile);
 uint8_t CurrentProfile(void);
 
+uint8_t ReadProfileNvram(uint8_t profile, uint8_t offset);
+void WriteProfileNvram(uint8_t profile, uint8_t offset, uint8_t value);
+
+uint8_t ReadGlobalNvram(uint8_t offset);
+void WriteGlobalNvram(uint8_t offset, uint8_t value);
+
 extern const uint8_t nvram_initial_data[NVRAM_INITIAL_DATA_SIZE];
 
 #endif // NVRAM_H
@@ -95,6 +95,9 @@ extern const struct{uint8_t report[HID_RPT01_SIZE];}hid_rpt01;
 #ifdef ENABLE_MOUSE
 extern const struct{uint8_t report[HID_RPT02_SIZE];}hid_rpt02;
 #endif
+#ifdef PROFILE_MAX
+extern const struct{uint8_t report[HID_RPT03_SIZE];}hid_rpt03;
+#endif
 
 // *****************************************************************************
 // *****************************************************************************
@@ -190,6 +193,14 @@ void USBCheckHIDRequest(void)
                             sizeof(USB_HID_DSC)+3,
                             USB_EP0_INCLUDE_ZERO);
                     }
+#endif
+#ifdef PROFILE_MAX
+                    else if (SetupPkt.bIntfID == HID_PROFILES_INTF_ID) {
+                        USBEP0SendROMPtr(
+                            (const uint8_t*)&configDescriptor1 + HID_PROFILES_DSC_OFFSET,
+                            sizeof(USB_HID_DSC)+3,
+                            USB_EP0_INCLUDE_ZERO);
+                    }
 #endif
                 }
                 break;
@@ -209,6 +220,14 @@ void USBCheckHIDRequest(void)
                             HID_RPT02_SIZE,     //See usbcfg.h
                             USB_EP0_INCLUDE_ZERO);
                     }
+#endif
+#ifdef PROFILE_MAX
+                    else if(SetupPkt.bIntfID == HID_PROFILES_INTF_ID) {
+                        USBEP0SendROMPtr(
+                            (const uint8_t*)&hid_rpt03,
+                            HID_RPT03_SIZE,     //See usbcfg.h
+                            USB_EP0_INCLUDE_ZERO);
+                    }
 #endif
                 }
                 break;
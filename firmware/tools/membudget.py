@@ -0,0 +1,291 @@
+#!/usr/bin/env python3
+#
+# Copyright 2026 Esrille Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Report RAM and flash use per source file and per table from an xc8 map.
+
+Usage:
+    membudget.py [--budget FILE] [--src PATH]... [--top N] [--update] MAPFILE
+
+Run it as a post-build step, e.g. from "Execute this line after build" in
+the MPLAB X project properties:
+
+    python3 ../tools/membudget.py ${ImageDir}/${PROJECTNAME}.${IMAGE_TYPE}.map
+
+The machine type is taken from the map file ("Machine type is 18F47J53"), and
+the matching lines of the budget file are checked.  The exit status is 1 if
+any entry has grown past its budget.  --update records the current per-file
+and per-symbol figures of that machine as the new budget; the "total" lines
+are device limits and are never rewritten.
+
+Symbol sizes are derived from the symbol table: each symbol extends to the
+next symbol in the same psect, or to the end of the psect.  Tables, i.e.
+symbols other than functions, of MAJOR_TABLE bytes or more are also tracked
+one by one.  Auto variables in the compiled stack (cstack*) are overlaid, so
+they are reported as a single "(stack)" entry instead of being charged to a
+source file.
+
+Symbols are charged to the source files that define them, found by scanning
+the sources given with --src, by default the firmware sources, the MLA
+application and board support sources, and the MLA USB device stack.  A
+static name defined in several files is charged to them jointly.  What
+remains, i.e. the C library, plib and the compiler runtime, is reported as
+"(other)".  tests/membudget.map is a sample map in the layout of xc8 v1.3x
+that "make check" in tests/ runs this script against.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+FLASH = 0   # xc8 space number of the program memory
+RAM = 1     # xc8 space number of the data memory
+
+MAJOR_TABLE = 32    # Data symbols at least this large are tracked one by one
+
+SPACE_NAMES = {FLASH: 'flash', RAM: 'ram'}
+SPACE_NUMBERS = {'flash': FLASH, 'ram': RAM}
+
+HEX = r'[0-9A-Fa-f]+'
+PSECT_LINE = re.compile(r'^\s+(\w+)\s+(%s)\s+(%s)\s+(%s)\s+(%s)\s+(\d+)(?:\s+\d+)?\s*$' % (HEX, HEX, HEX, HEX))
+SYMBOL_ENTRY = re.compile(r'(\S+)\s+(\w+)\s+(%s)(?=\s|$)' % HEX)
+
+FUNCTION_DEF = re.compile(r'^[A-Za-z_][\w \t\*]*?\b([A-Za-z_]\w*)\s*\(')
+# A definition may have an anonymous struct type as the USB string descriptors
+# do, a const pointer, and an address tag macro as the USB buffers do.
+VARIABLE_DEF = re.compile(r'^(?:static\s+|const\s+|volatile\s+)*'
+                          r'(?:struct\s*\{.*\}\s*|[A-Za-z_][\w \t]*?[\s\*]+(?:const\s+)?)'
+                          r'([A-Za-z_]\w*)\s*(?:\[[^\]]*\]\s*)*(?:[A-Z_][A-Z0-9_]*\s*)?(?:=|;)')
+
+# Sources built into the firmware, relative to the firmware directory
+MLA = os.path.join('third_party', 'mla_v2013_12_20')
+SOURCES = [
+    'src',
+    os.path.join(MLA, 'apps', 'usb', 'device', 'hid_keyboard', 'firmware', 'src'),
+    os.path.join(MLA, 'bsp'),
+    os.path.join(MLA, 'framework', 'usb', 'src', 'usb_device.c'),
+    os.path.join(MLA, 'framework', 'usb', 'src', 'usb_device_hid.c'),
+]
+
+
+def parse_map(path):
+    """Return (machine, psects, symbols) read from an xc8 map file."""
+    machine = None
+    psects = {}     # name -> [link, end, space]
+    symbols = []    # (name, psect, address)
+    in_symbols = False
+
+    with open(path, errors='replace') as f:
+        for line in f:
+            m = re.search(r'Machine type is (\S+)', line)
+            if m:
+                machine = m.group(1)
+                continue
+            if 'Symbol Table' in line:
+                in_symbols = True
+                continue
+            if in_symbols:
+                for name, psect, addr in SYMBOL_ENTRY.findall(line):
+                    symbols.append((name, psect, int(addr, 16)))
+                continue
+            m = PSECT_LINE.match(line)
+            if m:
+                name = m.group(1)
+                link = int(m.group(2), 16)
+                length = int(m.group(4), 16)
+                space = int(m.group(6))
+                if name in psects:
+                    p = psects[name]
+                    p[0] = min(p[0], link)
+                    p[1] = max(p[1], link + length)
+                else:
+                    psects[name] = [link, link + length, space]
+    return machine, psects, symbols
+
+
+def symbol_sizes(psects, symbols):
+    """Return a list of (name, psect, space, size)."""
+    by_psect = {}
+    for name, psect, addr in symbols:
+        if psect in psects:
+            by_psect.setdefault(psect, []).append((addr, name))
+
+    sizes = []
+    for psect, entries in by_psect.items():
+        link, end, space = psects[psect]
+        entries.sort()
+        for i, (addr, name) in enumerate(entries):
+            limit = entries[i + 1][0] if i + 1 < len(entries) else end
+            sizes.append((name, psect, space, max(0, limit - addr)))
+    return sizes
+
+
+def source_files(paths):
+    """Yield the .c files among the given files and directories."""
+    for path in paths:
+        if os.path.isfile(path):
+            yield path
+            continue
+        for root, dirs, files in os.walk(path):
+            dirs.sort()
+            for filename in sorted(files):
+                if filename.endswith('.c'):
+                    yield os.path.join(root, filename)
+
+
+def scan_sources(paths):
+    """Return a dict mapping a C identifier to the file(s) defining it."""
+    owners = {}
+    for path in source_files(paths):
+        filename = os.path.basename(path)
+        with open(path, errors='replace') as f:
+            for line in f:
+                if not line[:1].isalpha() or line.startswith(('typedef', 'extern', 'return')):
+                    continue
+                m = FUNCTION_DEF.match(line)
+                if m is None and '(' not in line:
+                    m = VARIABLE_DEF.match(line)
+                if m:
+                    files_of = owners.setdefault(m.group(1), [])
+                    if filename not in files_of:
+                        files_of.append(filename)
+    return owners
+
+
+def attribute(name, psect, owners):
+    """Return the source file label that owns a map symbol, or None to skip it."""
+    if name.startswith(('?', '__')):
+        return None
+    if psect.startswith('cstack'):
+        return '(stack)'
+    c_name = name.split('@', 1)[0]     # function@static_local
+    if c_name.startswith('_'):
+        c_name = c_name[1:]
+    files = owners.get(c_name)
+    if not files:
+        return '(other)'
+    return '+'.join(files)
+
+
+def read_budget(path):
+    entries = []
+    if os.path.exists(path):
+        with open(path) as f:
+            for line in f:
+                fields = line.split('#', 1)[0].split()
+                if len(fields) == 5:
+                    entries.append((fields[0], fields[1], fields[2], fields[3], int(fields[4], 0)))
+    return entries
+
+
+def write_budget(path, entries, machine, files, tables):
+    header = []
+    if os.path.exists(path):
+        with open(path) as f:
+            for line in f:
+                if line.startswith('#') or not line.strip():
+                    header.append(line)
+                else:
+                    break
+    kept = [e for e in entries if e[0] != machine or e[1] == 'total']
+    for label, usage in sorted(files.items()):
+        for space, size in sorted(usage.items()):
+            if size:
+                kept.append((machine, 'file', label, SPACE_NAMES[space], size))
+    for label, (space, size) in sorted(tables.items()):
+        kept.append((machine, 'symbol', label, SPACE_NAMES[space], size))
+    kept.sort(key=lambda e: (e[0], e[1] != 'total', e[1], e[2], e[3]))
+    with open(path, 'w') as f:
+        f.writelines(header)
+        for e in kept:
+            f.write('%-12s%-8s%-24s%-8s%d\n' % e)
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description='Report and check RAM/flash use from an xc8 map file.')
+    parser.add_argument('map', help='xc8 map file')
+    parser.add_argument('--budget', default=os.path.join(here, 'membudget.txt'), help='budget file')
+    parser.add_argument('--src', action='append', help='source file or directory to attribute symbols (repeatable)')
+    parser.add_argument('--top', type=int, default=12, help='number of largest tables to list')
+    parser.add_argument('--update', action='store_true', help='record the current figures as the budget')
+    args = parser.parse_args()
+
+    machine, psects, symbols = parse_map(args.map)
+    if machine is None:
+        sys.exit('%s: machine type not found; is this an xc8 map file?' % args.map)
+    owners = scan_sources(args.src or [os.path.join(here, '..', path) for path in SOURCES])
+
+    files = {}      # label -> {space: bytes}
+    tables = {}     # data symbol -> (space, bytes)
+    totals = {FLASH: 0, RAM: 0}
+    # xc8 marks the end of each function with __end_of_<function>, which
+    # tells the functions from the tables, as the interrupt code is not in a
+    # text psect.
+    functions = set(name[len('__end_of'):] for name, _, _ in symbols if name.startswith('__end_of_'))
+    for name, psect, space, size in symbol_sizes(psects, symbols):
+        if space not in SPACE_NAMES:
+            continue
+        label = attribute(name, psect, owners)
+        if label is None:
+            continue
+        usage = files.setdefault(label, {FLASH: 0, RAM: 0})
+        usage[space] += size
+        if label[0] != '(' and name not in functions and MAJOR_TABLE <= size:
+            tables[name.lstrip('_')] = (space, size)
+    for link, end, space in psects.values():
+        if space in totals:
+            totals[space] += end - link
+
+    print('Machine %s' % machine)
+    print('%-32s%10s%10s' % ('file', 'flash', 'ram'))
+    for label in sorted(files):
+        print('%-32s%10d%10d' % (label, files[label][FLASH], files[label][RAM]))
+    print('%-32s%10d%10d' % ('total (all psects)', totals[FLASH], totals[RAM]))
+    print()
+    print('Largest tables:')
+    largest = sorted(tables.items(), key=lambda t: -t[1][1])[:args.top]
+    for label, (space, size) in largest:
+        print('  %-30s%-6s%6d  %s' % (label, SPACE_NAMES[space], size, attribute('_' + label, '', owners)))
+
+    entries = read_budget(args.budget)
+    if args.update:
+        write_budget(args.budget, entries, machine, files, tables)
+        print('\nBudget for %s updated in %s' % (machine, args.budget))
+        return 0
+
+    over = 0
+    for m, kind, label, space_name, limit in entries:
+        if m != machine:
+            continue
+        space = SPACE_NUMBERS[space_name]
+        if kind == 'total':
+            actual = totals[space]
+        elif kind == 'file':
+            actual = files.get(label, {}).get(space, 0)
+        else:
+            actual = tables.get(label, (space, 0))[1]
+        if limit < actual:
+            print('OVER BUDGET: %s %s %s %d > %d (+%d)' % (kind, label, space_name, actual, limit, actual - limit))
+            over += 1
+    if over:
+        print('%d budget entr%s exceeded; run with --update if the growth is intended.' % (over, 'y' if over == 1 else 'ies'))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+#
+# Copyright 2026 Esrille Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Read and write the settings profiles of Esrille keyboards over USB.
+
+Usage:
+    profiles.py list
+    profiles.py read [--path PATH]
+    profiles.py apply [--jobs N] [--path PATH]... FILE
+
+The keyboard exposes the settings of all its profiles as a feature report of
+a vendor-defined collection on a HID interface of its own
+(app_device_keyboard.c).  "read" prints them as a profile file, and "apply" writes a profile file to every attached
+keyboard (or to the --path ones) in parallel, and reads it back to verify.
+The keyboard stalls the read-back until it has stored the profiles, so the
+read is retried for up to VERIFY_TIMEOUT seconds.
+
+A profile file is JSON.  Settings are named after the EEPROM_* offsets in
+Keyboard.h, and the ones left out keep the value read from the keyboard.
+EEPROM_MOUSE holds two settings: "pad" is the pad sensitivity from 0 for
+PAD_SENSE_1 to 3, and "curve" is the acceleration curve from 0 for the cubic
+one to PAD_CURVE_MAX in Mouse.h:
+
+    {
+        "current": 0,
+        "profiles": [
+            {"os": 0, "base": 1, "kana": 4, "delay": 0, "mod": 0},
+            {"os": 2, "pad": 1, "curve": 2}
+        ]
+    }
+
+The hidapi Python module is required (pip install hidapi).
+"""
+
+import argparse
+import concurrent.futures
+import json
+import sys
+import time
+
+import hid
+
+VENDOR_ID = 0x04D8
+PRODUCT_ID = 0xF550
+PROFILES_USAGE_PAGE = 0xFF00     # Vendor Defined Page 1
+PROFILES_USAGE = 0x01
+
+REPORT_FORMAT = 1
+REPORT_HEADER = 4       # format, profileMax, profileSize, currentProfile
+REPORT_MAX = 64
+
+VERIFY_TIMEOUT = 2.0    # [sec] The keyboard stores the profiles within about 12 msec.
+VERIFY_INTERVAL = 0.02  # [sec]
+
+# (offset, bits, maximum) of each setting.  The offsets are the EEPROM_*
+# ones in Keyboard.h, and EEPROM_MOUSE is split at PAD_CURVE_SHIFT in
+# Mouse.h.  The other bytes of a profile are unused, and are always left as
+# read.
+SETTINGS = {
+    'base': (0, 0xff, 0xff),
+    'kana': (1, 0xff, 0xff),
+    'os': (2, 0xff, 0xff),
+    'delay': (3, 0xff, 0xff),
+    'mod': (4, 0xff, 0xff),
+    'led': (5, 0xff, 0xff),
+    'ime': (6, 0xff, 0xff),
+    'pad': (7, 0x0f, 3),    # PAD_SENSE_MAX
+    'curve': (7, 0xf0, 3),  # PAD_CURVE_MAX
+    'prefix': (8, 0xff, 0xff),
+}
+
+
+def shift_of(bits):
+    return (bits & -bits).bit_length() - 1
+
+
+def keyboards():
+    """Return the hidapi paths of the attached keyboards."""
+    return [d['path'] for d in hid.enumerate(VENDOR_ID, PRODUCT_ID)
+            if d['usage_page'] == PROFILES_USAGE_PAGE and d['usage'] == PROFILES_USAGE]
+
+
+def get_report(device):
+    """Return the profiles report without the report number."""
+    report = bytes(device.get_feature_report(0, REPORT_MAX + 1))[1:]
+    if len(report) < REPORT_HEADER or report[0] != REPORT_FORMAT:
+        raise IOError('unknown profiles report format')
+    profile_max, profile_size = report[1], report[2]
+    if len(report) < REPORT_HEADER + profile_max * profile_size:
+        raise IOError('short profiles report')
+    return report[:REPORT_HEADER + profile_max * profile_size]
+
+
+def read_back(device):
+    """Return the profiles report once the keyboard has stored the last one."""
+    deadline = time.monotonic() + VERIFY_TIMEOUT
+    while True:
+        try:
+            return get_report(device)
+        except (IOError, OSError):
+            if deadline < time.monotonic():
+                raise
+        time.sleep(VERIFY_INTERVAL)
+
+
+def decode(report):
+    profile_max, profile_size, current = report[1], report[2], report[3]
+    profiles = []
+    for p in range(profile_max):
+        data = report[REPORT_HEADER + p * profile_size:REPORT_HEADER + (p + 1) * profile_size]
+        profiles.append({name: (data[offset] & bits) >> shift_of(bits)
+                         for name, (offset, bits, _) in SETTINGS.items() if offset < profile_size})
+    return {'current': current, 'profiles': profiles}
+
+
+def encode(report, config):
+    """Return the report with the settings of config applied to it."""
+    profile_max, profile_size = report[1], report[2]
+    report = bytearray(report)
+    if 'current' in config:
+        if not 0 <= config['current'] < profile_max:
+            raise ValueError('current: no profile %d' % config['current'])
+        report[3] = config['current']
+    profiles = config.get('profiles', [])
+    if profile_max < len(profiles):
+        raise ValueError('%d profiles given; the keyboard has %d' % (len(profiles), profile_max))
+    for p, settings in enumerate(profiles):
+        for name, value in settings.items():
+            if name not in SETTINGS or profile_size <= SETTINGS[name][0]:
+                raise ValueError('profile %d: unknown setting %s' % (p, name))
+            offset, bits, maximum = SETTINGS[name]
+            if not isinstance(value, int) or not 0 <= value <= maximum:
+                raise ValueError('profile %d: %s out of range' % (p, name))
+            at = REPORT_HEADER + p * profile_size + offset
+            report[at] = (report[at] & ~bits) | (value << shift_of(bits))
+    return bytes(report)
+
+
+def apply(path, config):
+    """Write config to the keyboard at path; return an error message or None."""
+    device = hid.device()
+    try:
+        device.open_path(path)
+        expected = encode(get_report(device), config)
+        device.send_feature_report([0] + list(expected))
+        if read_back(device) != expected:
+            return 'verify failed'
+    except (IOError, OSError, ValueError) as e:
+        return str(e)
+    finally:
+        device.close()
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Read and write the settings profiles of Esrille keyboards.')
+    sub = parser.add_subparsers(dest='command', required=True)
+    sub.add_parser('list', help='list the attached keyboards')
+    read = sub.add_parser('read', help='print the profiles of a keyboard')
+    read.add_argument('--path', help='hidapi path of the keyboard (default: the first one)')
+    write = sub.add_parser('apply', help='write a profile file to the keyboards')
+    write.add_argument('file', help='profile file')
+    write.add_argument('--path', action='append', help='hidapi path of a keyboard (repeatable; default: all)')
+    write.add_argument('--jobs', type=int, default=16, help='keyboards written at the same time')
+    args = parser.parse_args()
+
+    paths = keyboards()
+    if args.command == 'list':
+        for path in paths:
+            print(path.decode(errors='replace'))
+        return 0
+
+    if args.command == 'read':
+        path = args.path.encode() if args.path else (paths[0] if paths else None)
+        if path is None:
+            sys.exit('no keyboard found')
+        device = hid.device()
+        device.open_path(path)
+        try:
+            print(json.dumps(decode(get_report(device)), indent=4))
+        finally:
+            device.close()
+        return 0
+
+    with open(args.file) as f:
+        config = json.load(f)
+    if args.path:
+        paths = [p.encode() for p in args.path]
+    if not paths:
+        sys.exit('no keyboard found')
+    failed = 0
+    with concurrent.futures.ThreadPoolExecutor(max_workers=max(1, args.jobs)) as pool:
+        results = pool.map(lambda path: apply(path, config), paths)
+        for path, error in zip(paths, results):
+            print('%s: %s' % (path.decode(errors='replace'), error or 'ok'))
+            if error:
+                failed += 1
+    if failed:
+        print('%d of %d keyboards failed' % (failed, len(paths)))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())